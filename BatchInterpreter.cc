@@ -0,0 +1,209 @@
+/*
+ * BatchInterpreter.cc
+ *
+ *  Runs many state machines with the same structure, e.g. the tickers of
+ *  all the nodes, from one transition table.
+ */
+
+#include "BatchInterpreter.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace inet {
+
+BatchInterpreter::BatchInterpreter(StateMachine* structure)
+{
+    int n = structure->countStates();
+    for (int s = 0 ; s < n ; s++) {
+        for (Transition* t : structure->getState(s)->getTransitions()) {
+            if (std::find(alphabet.begin(), alphabet.end(), t->getMessageId()) == alphabet.end())
+                alphabet.push_back(t->getMessageId());
+        }
+    }
+    if (alphabet.size() > 64)
+        throw runtime_error("A batched state machine can use at most 64 message types");
+
+    enabled.assign(n, 0);
+    next.assign(n * 64, -1);
+    completion.assign(n, -1);
+    for (int s = 0 ; s < n ; s++) {
+        State* state = structure->getState(s);
+        for (Transition* t : state->getTransitions()) {
+            int bit = bitOf(t->getMessageId());
+            // like State::next(), the first transition for a message wins
+            if (enabled[s] & (1ull << bit)) continue;
+            enabled[s] |= 1ull << bit;
+            next[s * 64 + bit] = t->getTo();
+        }
+        if (state->hasCompletion())
+            completion[s] = state->completionTarget()->getIndex();
+    }
+}
+
+int BatchInterpreter::bitOf(MessageType m)
+{
+    for (unsigned int i = 0 ; i < alphabet.size() ; i++) {
+        if (alphabet[i] == m)
+            return i;
+    }
+    return -1;
+}
+
+bool BatchInterpreter::sameStructure(StateMachine* sm)
+{
+    if (sm->countStates() != (int)enabled.size())
+        return false;
+
+    for (int s = 0 ; s < sm->countStates() ; s++) {
+        State* state = sm->getState(s);
+        uint64_t mask = 0;
+        for (Transition* t : state->getTransitions()) {
+            int bit = bitOf(t->getMessageId());
+            if (bit < 0) return false;
+            if (!(mask & (1ull << bit)) && next[s * 64 + bit] != t->getTo()) return false;
+            mask |= 1ull << bit;
+        }
+        if (mask != enabled[s])
+            return false;
+        if ((state->hasCompletion() ? state->completionTarget()->getIndex() : -1) != completion[s])
+            return false;
+    }
+    return true;
+}
+
+int BatchInterpreter::add(StateMachine* sm, int owner)
+{
+    if (!sameStructure(sm))
+        throw runtime_error("The state machine " + sm->getName() + " does not have the structure of the batch");
+
+    int slot = machines.size();
+    machines.push_back(sm);
+    owners.push_back(owner);
+    current.push_back(sm->getStateIndex(sm->getInitialState()));
+    pending.push_back(0);
+    queued.push_back(0);
+    traces.push_back(nullptr);
+    traceIds.push_back(TRACE_NO_MACHINE);
+    sm->setBatch(this, slot);
+    return slot;
+}
+
+void BatchInterpreter::remove(int slot)
+{
+    if (machines[slot] == nullptr) return;
+
+    machines[slot]->setBatch(nullptr, -1);
+    machines[slot] = nullptr;
+    pending[slot] = 0;
+    traces[slot] = nullptr;
+}
+
+void BatchInterpreter::post(int slot, MessageType m)
+{
+    int bit = bitOf(m);
+    // no state would ever take it
+    if (bit < 0) return;
+
+    pending[slot] |= 1ull << bit;
+    if (!queued[slot]) {
+        queued[slot] = 1;
+        ready.push_back(slot);
+    }
+}
+
+void BatchInterpreter::filterRunnable()
+{
+    unsigned int kept = 0;
+    unsigned int i = 0;
+
+#ifdef __AVX2__
+    // four machines at a time: gather their pending masks and the masks enabled in their current state
+    const __m256i zero = _mm256_setzero_si256();
+    for ( ; i + 4 <= batch.size() ; i += 4) {
+        __m128i slots = _mm_loadu_si128((const __m128i*)&batch[i]);
+        __m256i p = _mm256_i32gather_epi64((const long long*)pending.data(), slots, 8);
+        __m128i states = _mm_i32gather_epi32((const int*)current.data(), slots, 4);
+        __m256i e = _mm256_i32gather_epi64((const long long*)enabled.data(), states, 8);
+        __m256i idle = _mm256_cmpeq_epi64(_mm256_and_si256(p, e), zero);
+        int mask = ~_mm256_movemask_pd(_mm256_castsi256_pd(idle)) & 0xf;
+        for (int lane = 0 ; lane < 4 ; lane++) {
+            if (mask & (1 << lane))
+                batch[kept++] = batch[i + lane];
+        }
+    }
+#endif
+
+    for ( ; i < batch.size() ; i++) {
+        int slot = batch[i];
+        if (pending[slot] & enabled[current[slot]])
+            batch[kept++] = slot;
+    }
+    batch.resize(kept);
+}
+
+void BatchInterpreter::enter(int slot, MessageType m)
+{
+    StateMachine* sm = machines[slot];
+    State* s = sm->getState(current[slot]);
+    if (traces[slot])
+        traces[slot]->record(TRACE_TRANSITION, traceIds[slot], current[slot], m, 0);
+    Envelope none;
+    s->getActions()->enteringState(s, sm, m, none);
+}
+
+bool BatchInterpreter::step(int owner)
+{
+    bool moved = false;
+
+    while (!ready.empty()) {
+        batch.swap(ready);
+        ready.clear();
+        unsigned int kept = 0;
+        for (int slot : batch) {
+            if (machines[slot] != nullptr && owners[slot] != owner) {
+                // stays queued, its owner steps it
+                deferred.push_back(slot);
+                continue;
+            }
+            queued[slot] = 0;
+            if (machines[slot] != nullptr)
+                batch[kept++] = slot;
+        }
+        batch.resize(kept);
+        filterRunnable();
+
+        for (int slot : batch) {
+            uint64_t runnable;
+            while ((runnable = pending[slot] & enabled[current[slot]]) != 0) {
+                // the lowest bit goes first, the pool would take the oldest message instead
+                int bit = __builtin_ctzll(runnable);
+                pending[slot] &= ~(1ull << bit);
+                current[slot] = next[current[slot] * 64 + bit];
+                enter(slot, alphabet[bit]);
+                while (completion[current[slot]] >= 0) {
+                    current[slot] = completion[current[slot]];
+                    enter(slot, MSG_TRUE);
+                }
+                moved = true;
+            }
+        }
+    }
+    ready.swap(deferred);
+
+    return moved;
+}
+
+size_t BatchInterpreter::footprint()
+{
+    return sizeof(BatchInterpreter) + alphabet.capacity() * sizeof(MessageType)
+            + enabled.capacity() * sizeof(uint64_t) + (next.capacity() + completion.capacity()) * sizeof(int32_t)
+            + machines.capacity() * (sizeof(StateMachine*) + sizeof(int) + sizeof(int32_t) + sizeof(uint64_t) + 2 + sizeof(EventTrace*))
+            + (ready.capacity() + batch.capacity() + deferred.capacity()) * sizeof(int);
+}
+
+} /* namespace inet */
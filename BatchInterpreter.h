@@ -0,0 +1,85 @@
+/*
+ * BatchInterpreter.h
+ *
+ *  Runs many state machines with the same structure, e.g. the tickers of
+ *  all the nodes, from one transition table.
+ */
+
+#ifndef BATCHINTERPRETER_H_
+#define BATCHINTERPRETER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "StateMachine.h"
+#include "EventTrace.h"
+
+namespace inet {
+
+/**
+ * The machines are kept as arrays (current state, pending messages) instead
+ * of one interpreter object each, and a step only looks at the machines that
+ * got a message since the last one.
+ *
+ * A machine only remembers which message types are pending, not how many
+ * times each one was reported, and the messages carry no extra data. That
+ * fits machines such as the tickers, where a repeated report means the same
+ * as a single one. At most 64 message types can be used by the structure.
+ *
+ * Each machine has an owner, the id of the module whose actions it runs. A
+ * step only moves the machines of one owner, so that the actions run in the
+ * context of their own module; the others wait for their owner's step.
+ */
+class BatchInterpreter {
+protected:
+    // transition table, built from the first machine
+    vector<MessageType> alphabet; // bit i of a pending mask is alphabet[i]
+    vector<uint64_t> enabled; // per state, the messages it has a transition for
+    vector<int32_t> next; // next[state * 64 + bit]
+    vector<int32_t> completion; // per state, -1 if none
+
+    // one entry per machine
+    vector<StateMachine*> machines; // nullptr once removed
+    vector<int> owners;
+    vector<int32_t> current;
+    vector<uint64_t> pending;
+    vector<uint8_t> queued;
+    vector<EventTrace*> traces;
+    vector<uint8_t> traceIds;
+
+    vector<int> ready; // machines that got a message since the last step
+    vector<int> batch; // the ones being stepped
+    vector<int> deferred; // ready machines of other owners
+
+    int bitOf(MessageType m);
+    bool sameStructure(StateMachine* sm);
+    // the machines in 'batch' with an enabled transition, in place
+    void filterRunnable();
+    void enter(int slot, MessageType m);
+public:
+    BatchInterpreter(StateMachine* structure);
+
+    // the machine must have the same structure as the first one, its reports go to the batch from now on
+    int add(StateMachine* sm, int owner);
+    // the machine is no longer moved by the batch, its slot is not reused
+    void remove(int slot);
+
+    // called by StateMachine::reportMessage()
+    void post(int slot, MessageType m);
+
+    // moves every machine of the owner until none has an enabled transition, false if nothing moved
+    bool step(int owner);
+
+    State* getCurrent(int slot) { return machines[slot]->getState(current[slot]); }
+    // used to warm start from a snapshot, no actions are executed
+    void setCurrent(int slot, State* s) { current[slot] = s->getIndex(); }
+
+    void setTrace(int slot, EventTrace* t, uint8_t id) { traces[slot] = t; traceIds[slot] = id; }
+
+    int count() { return machines.size(); }
+    size_t footprint();
+};
+
+} /* namespace inet */
+
+#endif /* BATCHINTERPRETER_H_ */
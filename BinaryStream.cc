@@ -0,0 +1,131 @@
+/*
+ * BinaryStream.cc
+ *
+ *  Helpers to write and read compact binary records (varints, strings)
+ */
+
+#include "BinaryStream.h"
+
+#include <cstring>
+
+namespace inet {
+
+// strings longer than this are considered a corrupted input
+static const uint64_t MAX_STRING_LENGTH = 1 << 24;
+
+void BinaryWriter::writeVarint(uint64_t v)
+{
+    while (v >= 0x80) {
+        out.put((char)((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.put((char)v);
+}
+
+void BinaryWriter::writeSignedVarint(int64_t v)
+{
+    // zig-zag so small negative values stay small
+    writeVarint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+void BinaryWriter::writeString(const string& s)
+{
+    writeVarint(s.size());
+    out.write(s.data(), s.size());
+}
+
+void BinaryWriter::writeDouble(double d)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    for (int i = 0 ; i < 8 ; i++)
+        out.put((char)((bits >> (8 * i)) & 0xff));
+}
+
+void BinaryWriter::writeZeros(uint64_t n)
+{
+    for (uint64_t i = 0 ; i < n ; i++)
+        out.put('\0');
+}
+
+void BinaryWriter::writeBytes(const uint8_t* data, uint64_t n)
+{
+    out.write((const char*)data, n);
+}
+
+int BinaryWriter::varintSize(uint64_t v)
+{
+    int n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+uint64_t BinaryReader::readVarint()
+{
+    uint64_t v = 0;
+    for (int shift = 0 ; shift < 64 ; shift += 7) {
+        int c = in.get();
+        if (c == EOF) {
+            good = false;
+            return 0;
+        }
+        v |= (uint64_t)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return v;
+    }
+    good = false;
+    return 0;
+}
+
+int64_t BinaryReader::readSignedVarint()
+{
+    uint64_t v = readVarint();
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+string BinaryReader::readString()
+{
+    uint64_t n = readVarint();
+    if (!good || n > MAX_STRING_LENGTH) {
+        good = false;
+        return string();
+    }
+    string s(n, '\0');
+    in.read(&s[0], n);
+    return s;
+}
+
+double BinaryReader::readDouble()
+{
+    uint64_t bits = 0;
+    for (int i = 0 ; i < 8 ; i++) {
+        int c = in.get();
+        if (c == EOF) {
+            good = false;
+            return 0;
+        }
+        bits |= (uint64_t)(c & 0xff) << (8 * i);
+    }
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+void BinaryReader::skip(uint64_t n)
+{
+    in.ignore(n);
+    if ((uint64_t)in.gcount() != n)
+        good = false;
+}
+
+void BinaryReader::readBytes(uint8_t* data, uint64_t n)
+{
+    in.read((char*)data, n);
+    if ((uint64_t)in.gcount() != n)
+        good = false;
+}
+
+} /* namespace inet */
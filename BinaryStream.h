@@ -0,0 +1,62 @@
+/*
+ * BinaryStream.h
+ *
+ *  Helpers to write and read compact binary records (varints, strings)
+ */
+
+#ifndef BINARYSTREAM_H_
+#define BINARYSTREAM_H_
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace inet {
+
+using std::string;
+
+/**
+ * Writes little-endian base-128 varints and length-prefixed strings
+ */
+class BinaryWriter {
+protected:
+    std::ostream& out;
+public:
+    BinaryWriter(std::ostream& o):out(o) {}
+
+    void writeVarint(uint64_t v);
+    void writeSignedVarint(int64_t v);
+    void writeString(const string& s);
+    void writeDouble(double d);
+    void writeZeros(uint64_t n);
+    void writeBytes(const uint8_t* data, uint64_t n);
+
+    bool ok() { return out.good(); }
+
+    // number of bytes used by writeVarint(v)
+    static int varintSize(uint64_t v);
+};
+
+/**
+ * Reads what BinaryWriter writes, ok() becomes false on truncated or corrupted input
+ */
+class BinaryReader {
+protected:
+    std::istream& in;
+    bool good = true;
+public:
+    BinaryReader(std::istream& i):in(i) {}
+
+    uint64_t readVarint();
+    int64_t readSignedVarint();
+    string readString();
+    double readDouble();
+    void skip(uint64_t n);
+    void readBytes(uint8_t* data, uint64_t n);
+
+    bool ok() { return good && !in.fail(); }
+};
+
+} /* namespace inet */
+
+#endif /* BINARYSTREAM_H_ */
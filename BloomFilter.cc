@@ -0,0 +1,56 @@
+/*
+ * BloomFilter.cc
+ *
+ *  Compact set of topic ids advertised in the hellos
+ */
+
+#include "BloomFilter.h"
+
+#include <algorithm>
+
+namespace inet {
+
+BloomFilter::BloomFilter(int bits, int hashes)
+{
+    data.assign(1 + (std::max(bits, 8) + 7) / 8, 0);
+    data[0] = (uint8_t)std::min(std::max(hashes, 1), 255);
+}
+
+uint64_t BloomFilter::mix(uint64_t v)
+{
+    // splitmix64 finalizer
+    v += 0x9e3779b97f4a7c15ULL;
+    v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    v = (v ^ (v >> 27)) * 0x94d049bb133111ebULL;
+    return v ^ (v >> 31);
+}
+
+void BloomFilter::add(int topic)
+{
+    if (data.empty()) return;
+
+    // double hashing, the k positions come from two halves of one hash
+    uint64_t h = mix((uint64_t)(uint32_t)topic);
+    uint64_t bits = (data.size() - 1) * 8;
+    for (int k = 0 ; k < data[0] ; k++) {
+        uint64_t bit = ((h & 0xffffffff) + k * (h >> 32)) % bits;
+        data[1 + bit / 8] |= 1 << (bit % 8);
+    }
+}
+
+bool BloomFilter::mayContain(const vector<uint8_t>& bytes, int topic)
+{
+    // nothing to test against, the sender takes everything
+    if (bytes.size() < 2) return true;
+
+    uint64_t h = mix((uint64_t)(uint32_t)topic);
+    uint64_t bits = (bytes.size() - 1) * 8;
+    for (int k = 0 ; k < bytes[0] ; k++) {
+        uint64_t bit = ((h & 0xffffffff) + k * (h >> 32)) % bits;
+        if ((bytes[1 + bit / 8] & (1 << (bit % 8))) == 0)
+            return false;
+    }
+    return true;
+}
+
+} /* namespace inet */
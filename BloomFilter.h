@@ -0,0 +1,42 @@
+/*
+ * BloomFilter.h
+ *
+ *  Compact set of topic ids advertised in the hellos
+ */
+
+#ifndef BLOOMFILTER_H_
+#define BLOOMFILTER_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace inet {
+
+using std::vector;
+
+/**
+ * The first byte holds the number of hash functions and the rest the bits, so a
+ * filter can be tested by a node that does not know how it was built.
+ * An empty filter stands for every topic.
+ */
+class BloomFilter {
+protected:
+    vector<uint8_t> data;
+
+    static uint64_t mix(uint64_t v);
+public:
+    BloomFilter() {}
+    BloomFilter(int bits, int hashes);
+    explicit BloomFilter(const vector<uint8_t>& bytes):data(bytes) {}
+
+    void add(int topic);
+    bool mayContain(int topic) const { return mayContain(data, topic); }
+    bool isEmpty() const { return data.empty(); }
+    const vector<uint8_t>& bytes() const { return data; }
+
+    static bool mayContain(const vector<uint8_t>& bytes, int topic);
+};
+
+} /* namespace inet */
+
+#endif /* BLOOMFILTER_H_ */
@@ -0,0 +1,111 @@
+/*
+ * Envelope.h
+ *
+ *  The object that travels with a message in the MessagePool.
+ */
+
+#ifndef ENVELOPE_H_
+#define ENVELOPE_H_
+
+#include <stdexcept>
+
+namespace inet {
+
+/**
+ * Move-only holder of what goes with a message, usually a received packet.
+ * An owned payload is deleted with the envelope unless an action takes it
+ * with release(); a borrowed one (e.g. a timer kept by somebody else) is
+ * never deleted. The envelope is tagged with the type it was made with,
+ * get() and release() throw if they are asked for another one, e.g. when a
+ * message type is reported with the wrong payload.
+ */
+class Envelope {
+protected:
+    void* payload = nullptr;
+    void (*dispose)(void*) = nullptr; // nullptr for a borrowed payload
+    const void* tag = nullptr; // tagOf() the payload type
+
+    // one address per type, no RTTI needed
+    template<class T>
+    static const void* tagOf() {
+        static const char t = 0;
+        return &t;
+    }
+public:
+    Envelope() {}
+    Envelope(const Envelope& other) = delete;
+    Envelope& operator=(const Envelope& other) = delete;
+
+    Envelope(Envelope&& other):payload(other.payload), dispose(other.dispose), tag(other.tag) {
+        other.payload = nullptr;
+        other.dispose = nullptr;
+        other.tag = nullptr;
+    }
+
+    Envelope& operator=(Envelope&& other) {
+        if (this != &other) {
+            reset();
+            payload = other.payload;
+            dispose = other.dispose;
+            tag = other.tag;
+            other.payload = nullptr;
+            other.dispose = nullptr;
+            other.tag = nullptr;
+        }
+        return *this;
+    }
+
+    ~Envelope() { reset(); }
+
+    template<class T>
+    static Envelope owning(T* p) {
+        Envelope e;
+        e.payload = p;
+        e.dispose = [] (void* q) { delete static_cast<T*>(q); };
+        e.tag = tagOf<T>();
+        return e;
+    }
+
+    template<class T>
+    static Envelope borrowing(T* p) {
+        Envelope e;
+        e.payload = p;
+        e.tag = tagOf<T>();
+        return e;
+    }
+
+    bool isEmpty() const { return payload == nullptr; }
+
+    template<class T>
+    bool holds() const { return payload != nullptr && tag == tagOf<T>(); }
+
+    // T must be the type the envelope was made with, an empty envelope gives nullptr
+    template<class T>
+    T* get() const {
+        if (payload != nullptr && tag != tagOf<T>())
+            throw std::runtime_error("The envelope does not hold a payload of the requested type");
+        return static_cast<T*>(payload);
+    }
+
+    // the caller becomes responsible for an owned payload
+    template<class T>
+    T* release() {
+        T* p = get<T>();
+        payload = nullptr;
+        dispose = nullptr;
+        tag = nullptr;
+        return p;
+    }
+
+    void reset() {
+        if (payload != nullptr && dispose != nullptr)
+            dispose(payload);
+        payload = nullptr;
+        dispose = nullptr;
+        tag = nullptr;
+    }
+};
+
+} /* namespace inet */
+
+#endif /* ENVELOPE_H_ */
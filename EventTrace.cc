@@ -0,0 +1,70 @@
+/*
+ * EventTrace.cc
+ *
+ *  Fixed-size ring buffer of binary events
+ */
+
+#include "EventTrace.h"
+#include "BinaryStream.h"
+
+#include <fstream>
+
+namespace inet {
+
+// "GTRC" followed by the version of the format
+const uint64_t TRACE_MAGIC = 0x43525447;
+const uint64_t TRACE_VERSION = 1;
+
+EventTrace::EventTrace(unsigned int capacity)
+{
+    uint64_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    records.resize(size);
+    mask = size - 1;
+}
+
+void EventTrace::describeMachine(uint8_t machine, const string& name, const vector<string>& states)
+{
+    if (machine >= machineNames.size()) {
+        machineNames.resize(machine + 1);
+        stateNames.resize(machine + 1);
+    }
+    machineNames[machine] = name;
+    stateNames[machine] = states;
+}
+
+bool EventTrace::dump(const string& fileName, const string& node)
+{
+    std::ofstream f(fileName.c_str(), std::ios::binary | std::ios::trunc);
+    BinaryWriter w(f);
+
+    w.writeVarint(TRACE_MAGIC);
+    w.writeVarint(TRACE_VERSION);
+    w.writeString(node);
+
+    w.writeVarint(machineNames.size());
+    for (unsigned int m = 0 ; m < machineNames.size() ; m++) {
+        w.writeString(machineNames[m]);
+        w.writeVarint(stateNames[m].size());
+        for (const string& s : stateNames[m])
+            w.writeString(s);
+    }
+
+    uint64_t first = count > records.size() ? count - records.size() : 0;
+    w.writeVarint(count - first);
+    w.writeVarint(first); // records lost before the oldest one
+    for (uint64_t k = first ; k < count ; k++) {
+        TraceRecord& r = records[k & mask];
+        w.writeDouble(r.time);
+        w.writeVarint(r.type);
+        w.writeVarint(r.machine);
+        w.writeVarint(r.state);
+        w.writeSignedVarint(r.arg0);
+        w.writeSignedVarint(r.arg1);
+    }
+
+    return w.ok();
+}
+
+} /* namespace inet */
@@ -0,0 +1,80 @@
+/*
+ * EventTrace.h
+ *
+ *  Fixed-size ring buffer of binary events, cheap enough to stay enabled
+ *  in large runs. tools/decode_trace.py turns a dump into text or CSV.
+ */
+
+#ifndef EVENTTRACE_H_
+#define EVENTTRACE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace inet {
+
+using std::string;
+using std::vector;
+
+enum TraceEventTypes {
+    TRACE_TRANSITION = 1, // machine, state, message
+    TRACE_SEND = 2, // packet type, id
+    TRACE_RECEIVE = 3, // packet type, id
+    TRACE_TIMER = 4 // timer kind
+};
+
+const uint8_t TRACE_NO_MACHINE = 0xff;
+
+class TraceRecord {
+public:
+    double time;
+    uint8_t type;
+    uint8_t machine;
+    uint16_t state;
+    int32_t arg0;
+    int32_t arg1;
+};
+
+/**
+ * Keeps the last 2^k records, older ones are overwritten
+ */
+class EventTrace {
+protected:
+    vector<TraceRecord> records;
+    uint64_t mask;
+    uint64_t count = 0;
+    double now = 0;
+
+    // names used by the decoder
+    vector<string> machineNames;
+    vector< vector<string> > stateNames;
+public:
+    // the capacity is rounded up to a power of two
+    EventTrace(unsigned int capacity);
+
+    // the time given to the following records
+    void setTime(double t) { now = t; }
+
+    void record(uint8_t type, uint8_t machine, uint16_t state, int32_t arg0, int32_t arg1) {
+        TraceRecord& r = records[count & mask];
+        r.time = now;
+        r.type = type;
+        r.machine = machine;
+        r.state = state;
+        r.arg0 = arg0;
+        r.arg1 = arg1;
+        count++;
+    }
+
+    void describeMachine(uint8_t machine, const string& name, const vector<string>& states);
+
+    uint64_t recorded() { return count; }
+
+    // writes the records from oldest to newest, returns false if the file cannot be written
+    bool dump(const string& fileName, const string& node);
+};
+
+} /* namespace inet */
+
+#endif /* EVENTTRACE_H_ */
@@ -0,0 +1,147 @@
+/*
+ * Gf256.cc
+ *
+ *  Arithmetic in GF(2^8) (polynomial 0x11d) for network coding.
+ */
+
+#include "Gf256.h"
+
+// the SSSE3 code is built whatever the target and only used if the CPU has it
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GF256_SSSE3
+#include <tmmintrin.h>
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+
+namespace inet {
+
+class Gf256Tables {
+public:
+    uint8_t exp[512];
+    uint8_t log[256];
+
+    Gf256Tables() {
+        int x = 1;
+        for (int i = 0 ; i < 255 ; i++) {
+            exp[i] = x;
+            log[x] = i;
+            x <<= 1;
+            if (x & 0x100)
+                x ^= 0x11d;
+        }
+        // so exp[log a + log b] needs no modulo
+        for (int i = 255 ; i < 512 ; i++)
+            exp[i] = exp[i - 255];
+        log[0] = 0;
+    }
+};
+
+static const Gf256Tables tables;
+
+uint8_t gf256Mul(uint8_t a, uint8_t b)
+{
+    if (a == 0 || b == 0) return 0;
+    return tables.exp[tables.log[a] + tables.log[b]];
+}
+
+uint8_t gf256Inv(uint8_t a)
+{
+    return tables.exp[255 - tables.log[a]];
+}
+
+#ifdef GF256_SSSE3
+
+static bool cpuHasSsse3()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("ssse3");
+}
+
+static const bool hasSsse3 = cpuHasSsse3();
+
+// products of c by every low nibble and by every high nibble
+SSSE3_TARGET static void nibbleTables(uint8_t c, __m128i& low, __m128i& high)
+{
+    alignas(16) uint8_t l[16], h[16];
+    for (int i = 0 ; i < 16 ; i++) {
+        l[i] = gf256Mul(c, i);
+        h[i] = gf256Mul(c, i << 4);
+    }
+    low = _mm_load_si128((const __m128i*)l);
+    high = _mm_load_si128((const __m128i*)h);
+}
+
+SSSE3_TARGET static inline __m128i mul16(__m128i x, __m128i low, __m128i high)
+{
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    __m128i l = _mm_and_si128(x, mask);
+    __m128i h = _mm_and_si128(_mm_srli_epi64(x, 4), mask);
+    return _mm_xor_si128(_mm_shuffle_epi8(low, l), _mm_shuffle_epi8(high, h));
+}
+
+// both return how many bytes they did, the rest is left to the scalar loop
+SSSE3_TARGET static size_t mulAddRegionSsse3(uint8_t* dst, const uint8_t* src, uint8_t c, size_t n)
+{
+    __m128i low, high;
+    nibbleTables(c, low, high);
+    size_t i = 0;
+    for ( ; i + 16 <= n ; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(d, mul16(x, low, high)));
+    }
+    return i;
+}
+
+SSSE3_TARGET static size_t mulRegionSsse3(uint8_t* dst, uint8_t c, size_t n)
+{
+    __m128i low, high;
+    nibbleTables(c, low, high);
+    size_t i = 0;
+    for ( ; i + 16 <= n ; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(dst + i));
+        _mm_storeu_si128((__m128i*)(dst + i), mul16(x, low, high));
+    }
+    return i;
+}
+
+#endif
+
+void gf256MulAddRegion(uint8_t* dst, const uint8_t* src, uint8_t c, size_t n)
+{
+    if (c == 0) return;
+
+    size_t i = 0;
+    if (c == 1) {
+        for ( ; i < n ; i++)
+            dst[i] ^= src[i];
+        return;
+    }
+
+#ifdef GF256_SSSE3
+    if (hasSsse3)
+        i = mulAddRegionSsse3(dst, src, c, n);
+#endif
+
+    const uint8_t* e = tables.exp + tables.log[c];
+    for ( ; i < n ; i++) {
+        if (src[i] != 0)
+            dst[i] ^= e[tables.log[src[i]]];
+    }
+}
+
+void gf256MulRegion(uint8_t* dst, uint8_t c, size_t n)
+{
+    if (c == 1) return;
+
+    size_t i = 0;
+#ifdef GF256_SSSE3
+    if (hasSsse3)
+        i = mulRegionSsse3(dst, c, n);
+#endif
+
+    for ( ; i < n ; i++)
+        dst[i] = gf256Mul(c, dst[i]);
+}
+
+} /* namespace inet */
@@ -0,0 +1,29 @@
+/*
+ * Gf256.h
+ *
+ *  Arithmetic in GF(2^8) (polynomial 0x11d) for network coding.
+ *  The region operations use SSSE3 shuffles when the CPU has them.
+ */
+
+#ifndef GF256_H_
+#define GF256_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace inet {
+
+uint8_t gf256Mul(uint8_t a, uint8_t b);
+
+// a must not be 0
+uint8_t gf256Inv(uint8_t a);
+
+// dst[i] ^= c * src[i]
+void gf256MulAddRegion(uint8_t* dst, const uint8_t* src, uint8_t c, size_t n);
+
+// dst[i] = c * dst[i]
+void gf256MulRegion(uint8_t* dst, uint8_t c, size_t n);
+
+} /* namespace inet */
+
+#endif /* GF256_H_ */
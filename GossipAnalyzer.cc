@@ -0,0 +1,143 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+#include "GossipAnalyzer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace inet {
+
+Define_Module(GossipAnalyzer);
+
+void GossipAnalyzer::initialize()
+{
+    perMessageScalars = par("perMessageScalars").boolValue();
+    networkMemoryVector.setName("networkMemory");
+
+    cStringTokenizer tokenizer(par("coverageLevels"));
+    const char *token;
+    while ((token = tokenizer.nextToken()) != nullptr)
+        coverageLevels.push_back(atof(token));
+}
+
+void GossipAnalyzer::handleMessage(cMessage *msg)
+{
+    throw cRuntimeError("GossipAnalyzer does not process messages");
+}
+
+void GossipAnalyzer::registerNode()
+{
+    Enter_Method_Silent();
+    numNodes++;
+}
+
+void GossipAnalyzer::messageCreated(const string& source, int id)
+{
+    Enter_Method_Silent();
+    MessageRecord& r = messages[std::make_pair(source, id)];
+    r.created = SIMTIME_DBL(simTime());
+    // the source already has it
+    r.receipts.push_back(r.created);
+}
+
+void GossipAnalyzer::messageReceived(const string& source, int id, bool duplicate)
+{
+    Enter_Method_Silent();
+    MessageRecord& r = messages[std::make_pair(source, id)];
+    if (duplicate)
+        r.duplicates++;
+    else
+        r.receipts.push_back(SIMTIME_DBL(simTime()));
+}
+
+void GossipAnalyzer::memoryUsage(const string& node, long bytes)
+{
+    Enter_Method_Silent();
+    long& last = nodeMemory[node];
+    networkMemory += bytes - last;
+    last = bytes;
+
+    long& peak = nodeMemoryPeak[node];
+    peak = std::max(peak, bytes);
+    if (networkMemory > networkMemoryPeak)
+        networkMemoryPeak = networkMemory;
+    networkMemoryVector.record(networkMemory);
+}
+
+void GossipAnalyzer::finish()
+{
+    vector<cStdDev> coverageTimes(coverageLevels.size());
+    for (unsigned int k = 0 ; k < coverageLevels.size() ; k++) {
+        std::ostringstream name;
+        name << "timeToCoverage" << coverageLevels[k] * 100;
+        coverageTimes[k].setName(name.str().c_str());
+    }
+    cStdDev reach("reach");
+    cStdDev redundancy("redundancy");
+    long notCovered = 0;
+
+    for (auto& m : messages) {
+        MessageRecord& r = m.second;
+        if (r.receipts.empty()) continue;
+        std::ostringstream prefix;
+        prefix << m.first.first << "#" << m.first.second << " ";
+
+        // a source without analyzer does not report the creation
+        double origin = r.created >= 0 ? r.created : r.receipts.front();
+
+        for (unsigned int k = 0 ; k < coverageLevels.size() ; k++) {
+            unsigned int needed = (unsigned int)std::ceil(coverageLevels[k] * numNodes);
+            if (needed == 0) needed = 1;
+            if (needed > r.receipts.size()) {
+                notCovered++;
+                continue;
+            }
+            double t = r.receipts[needed - 1] - origin;
+            coverageTimes[k].collect(t);
+            if (perMessageScalars)
+                recordScalar((prefix.str() + coverageTimes[k].getName()).c_str(), t, "s");
+        }
+
+        double fraction = numNodes > 0 ? (double)r.receipts.size() / numNodes : 0;
+        // the source does not receive its own message through the network
+        double useful = r.receipts.size() > 1 ? r.receipts.size() - 1 : 1;
+        reach.collect(fraction);
+        redundancy.collect(r.duplicates / useful);
+        if (perMessageScalars) {
+            recordScalar((prefix.str() + "reach").c_str(), fraction);
+            recordScalar((prefix.str() + "redundancy").c_str(), r.duplicates / useful);
+        }
+    }
+
+    recordScalar("nodes", numNodes);
+    recordScalar("messages", messages.size());
+    recordScalar("coverageLevelsNotReached", notCovered);
+    for (cStdDev& s : coverageTimes)
+        s.record();
+    reach.record();
+    redundancy.record();
+
+    // the nodes report during the simulation, they may finish after us
+    cStdDev nodePeaks("nodeMemoryPeak");
+    for (auto& n : nodeMemoryPeak)
+        nodePeaks.collect(n.second);
+    recordScalar("networkMemory", networkMemory, "B");
+    recordScalar("networkMemoryPeak", networkMemoryPeak, "B");
+    nodePeaks.record();
+}
+
+} //namespace
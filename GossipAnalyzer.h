@@ -0,0 +1,77 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+#ifndef __INET_GOSSIPANALYZER_H_
+#define __INET_GOSSIPANALYZER_H_
+
+#include <omnetpp.h>
+
+#include <map>
+#include <vector>
+#include <string>
+
+#include "inet/common/INETDefs.h"
+
+namespace inet {
+
+using std::map;
+using std::vector;
+using std::string;
+
+/**
+ * Collects the first receipt of every message in every node.
+ * Nothing is logged per node, only a few counters and the receipt times per message.
+ */
+class INET_API GossipAnalyzer : public cSimpleModule
+{
+  protected:
+    class MessageRecord {
+    public:
+        double created = -1;
+        vector<double> receipts; // first receipt in each node, in order of time
+        long duplicates = 0;
+    };
+    map<std::pair<string, int>, MessageRecord> messages;
+
+    int numNodes = 0;
+    vector<double> coverageLevels;
+
+    // memory, the last sample and the peak of every node
+    map<string, long> nodeMemory;
+    map<string, long> nodeMemoryPeak;
+    long networkMemory = 0;
+    long networkMemoryPeak = 0;
+    cOutVector networkMemoryVector;
+    bool perMessageScalars = true;
+
+  protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+    virtual void finish() override;
+
+  public:
+    // every application taking part in the dissemination calls it once
+    void registerNode();
+
+    void messageCreated(const string& source, int id);
+    void messageReceived(const string& source, int id, bool duplicate);
+
+    // bytes held by a node, see GossipPush::measureMemory()
+    void memoryUsage(const string& node, long bytes);
+};
+
+} //namespace
+
+#endif
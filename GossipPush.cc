@@ -16,24 +16,53 @@
 #include "GossipPush.h"
 #include "Gossip_m.h"
 #include "GossipHello_m.h"
+#include "BinaryStream.h"
+#include "GossipWire.h"
 
+#include "inet/common/ModuleAccess.h"
 #include "inet/networklayer/common/L3AddressResolver.h"
 #include "inet/transportlayer/contract/udp/UDPControlInfo.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <sstream>
 
 namespace inet {
 
 Define_Module(GossipPush);
 
+simsignal_t GossipPush::infectionStoreSizeSignal = registerSignal("infectionStoreSize");
+simsignal_t GossipPush::pendingSendsSignal = registerSignal("pendingSends");
+
 enum ControlMessageTypes {
     IDLE,
     START,
     NEW_GOSSIP,
     GOSSIP,
-    SAY_HELLO
+    SAY_HELLO,
+    SEND_PENDING,
+    GRAFT_TIMEOUT,
+    SAMPLE_MEMORY
+};
+
+// the tickers of the nodes with batchTickers, they have the same structure; owned by the
+// network module, so it goes away with the network and a later run starts with a new one
+class TickerBatch : public cOwnedObject {
+public:
+    BatchInterpreter batch;
+    TickerBatch(StateMachine* structure) : cOwnedObject("tickerBatch"), batch(structure) {}
 };
 
+static const char* memoryCategoryNames[] = {
+    "infections", "members", "neighbors", "pool", "timers", "machines", "sends", "total"
+};
+
+// "GSNP" followed by the version of the format
+const uint64_t SNAPSHOT_MAGIC = 0x504e5347;
+const uint64_t SNAPSHOT_VERSION = 7;
+
 enum GossipProtocolMessages {
     MSG_INITIALIZE = 57,
     MSG_NEW_GOSSIP = 58,
@@ -42,7 +71,15 @@ enum GossipProtocolMessages {
     MSG_GREET = 61,
     MSG_HELLO = 62,
     MSG_DATA = 63,
-    MSG_GOSSIP = 64
+    MSG_GOSSIP = 64,
+    MSG_IHAVE = 65,
+    MSG_GRAFT = 66,
+    MSG_PRUNE = 67,
+    MSG_GRAFT_TIMEOUT = 68,
+    MSG_CODED = 69,
+    MSG_RELAY = 70,
+    MSG_PROMOTED = 71,
+    MSG_DEMOTED = 72
 };
 
 
@@ -55,9 +92,29 @@ void GossipPush::initialize(int stage)
 
         isSource = par("isSource").boolValue();
 
+        if (par("networkCoding").boolValue() && (par("chunkSize").longValue() <= 0 || par("generationSize").longValue() <= 0))
+            throw cRuntimeError("networkCoding needs a positive chunkSize and generationSize");
+        // a crashed aggregator is only replaced once the members forget it
+        if (par("hierarchical").boolValue() && par("failureDetector").stdstringValue() != "phi" && par("suspicionTimeout").doubleValue() <= 0)
+            throw cRuntimeError("hierarchical mode needs a failure detector, set failureDetector to phi or a positive suspicionTimeout");
+
         EV_TRACE << "Initialized as source : " << isSource << "\n";
 
+        startTime = par("startTime").doubleValue();
+        startJitter = par("startJitter").doubleValue();
+
+        if (par("analyzerModule").stdstringValue() != "") {
+            analyzer = getModuleFromPar<GossipAnalyzer>(par("analyzerModule"), this);
+            analyzer->registerNode();
+        }
+
         ctrlMsg0 = new cMessage("controlMSG", IDLE);
+        sendTimer = new cMessage("sendPending", SEND_PENDING);
+
+        memorySampleInterval = par("memorySampleInterval").doubleValue();
+        memoryTimer = new cMessage("sampleMemory", SAMPLE_MEMORY);
+        for (int k = 0 ; k <= MEMORY_CATEGORIES ; k++)
+            memoryVectors[k].setName((string("memory.") + memoryCategoryNames[k]).c_str());
     }
 }
 
@@ -66,15 +123,31 @@ void GossipPush::handleMessageWhenUp(cMessage *msg)
     cPacket* pkt = nullptr;
     map<cMessage*, ITimeOut*>::iterator it;
 
+    if (eventTrace)
+        eventTrace->setTime(SIMTIME_DBL(simTime()));
 
     if (msg->isSelfMessage()) {
 
         switch (msg->getKind()) {
             case START:
                 processStart();
-                sm_proptocol->reportMessage(MSG_INITIALIZE);
+                if (!warmStarted)
+                    sm_proptocol->reportMessage(MSG_INITIALIZE);
+                break;
+            case SEND_PENDING:
+                sendPending();
+                break;
+            case SAMPLE_MEMORY:
+                sampleMemory();
+                scheduleAt(simTime() + memorySampleInterval, memoryTimer);
+                break;
+            case GRAFT_TIMEOUT:
+                // the timer stays with its entry in 'missing'
+                sm_proptocol->getPool()->add(MSG_GRAFT_TIMEOUT, Envelope::borrowing(msg));
                 break;
             case TICK_MESSAGE:
+                if (eventTrace)
+                    eventTrace->record(TRACE_TIMER, TRACE_NO_MACHINE, 0, TICK_MESSAGE, 0);
                 it = timers.find(msg);
                 if (it != timers.end()) {
                     it->second->timeOut();
@@ -92,11 +165,13 @@ void GossipPush::handleMessageWhenUp(cMessage *msg)
 
         EV_TRACE << "A network message\n";
 
-        bool done = processReceivedGossip(pkt);
-        done = done || processReceivedHello(pkt);
+        // the only cast, the wire type tells the rest
+        GossipPacket* gpkt = dynamic_cast<GossipPacket*>(pkt);
 
         // unknown package
-        if (!done) {
+        if (gpkt == nullptr || !processReceived(gpkt)) {
+            if (eventTrace)
+                eventTrace->record(TRACE_RECEIVE, TRACE_NO_MACHINE, 0, 0, 0);
             delete pkt;
         }
     }
@@ -105,42 +180,105 @@ void GossipPush::handleMessageWhenUp(cMessage *msg)
 
 }
 
+// index of a module name such as "host[12]", -1 if it is not part of a vector
+static int moduleIndex(const string& name)
+{
+    size_t open = name.rfind('[');
+    return open == string::npos ? -1 : atoi(name.c_str() + open + 1);
+}
+
+// the content is not simulated, any bytes will do as long as the receivers can tell what they should decode
+static vector<uint8_t> codedContent(int idMsg, int length)
+{
+    vector<uint8_t> payload(length);
+    for (unsigned int i = 0 ; i < payload.size() ; i++)
+        payload[i] = (uint8_t)(i * 131 + idMsg);
+    return payload;
+}
+
 void GossipPush::newGossip() {
     EV_TRACE << "Message Received\n";
-    if (isSource && numMessages > 0) {
+    if (isSource && numMessages != 0) {
         /* let's create the infection */
         GossipPush::GossipInfection infection;
         infection.idMsg = lastIdMsg++;
         infection.roundsLeft = roundRatio;
+        infection.learnt = SIMTIME_DBL(simTime());
         infection.source = myAddress.str();
-        infection.text = "A message is nice";
+        infection.topic = par("publishTopic");
+        if (arrivalProcess == ARRIVAL_TRACE)
+            infection.payloadLength = trace[traceNext++].payloadLength;
+        else
+            infection.payloadLength = par("payloadSize").longValue();
+        if (networkCoding && !plumtree) {
+            infection.coded.reset(RlncPayload::fromPayload(codedContent(infection.idMsg, infection.payloadLength), chunkSize, generationSize));
+            // coded pieces do not carry a topic
+            infection.topic = 0;
+            // each round gives at most one piece to each target
+            infection.roundsLeft = roundRatio * infection.coded->getK();
+        }
         infections.push_back(infection);
+        emit(infectionStoreSizeSignal, (long)infections.size());
+        if (analyzer)
+            analyzer->messageCreated(infection.source, infection.idMsg);
+        if (plumtree) {
+            infections.back().roundsLeft = 0;
+            plumtreeBroadcast(infection, nullptr);
+        }
         /* reduce the number of future infections */
-        numMessages--;
+        if (numMessages > 0)
+            numMessages--;
     }
 }
 
-bool GossipPush::processReceivedGossip(cPacket * pkt)
+bool GossipPush::processReceived(GossipPacket* pkt)
 {
-
-    Gossip* g = check_and_cast_nullable<Gossip*>(dynamic_cast<Gossip*>(pkt));
-
-    if ( g == nullptr ) return false;
-
-    sm_proptocol->getPool()->add(MSG_DATA, pkt);
-
-    return true;
-}
-
-bool GossipPush::processReceivedHello(cPacket * pkt) {
-
-    GossipHello* gh = check_and_cast_nullable<GossipHello*>(dynamic_cast<GossipHello*>(pkt));
-
-    if (gh == nullptr) return false;
-
-    sm_proptocol->getPool()->add(MSG_HELLO, pkt);
-
-    return true;
+    MessagePool* pool = sm_proptocol->getPool();
+
+    switch (pkt->getWireType()) {
+        case WIRE_GOSSIP: {
+            Gossip* g = static_cast<Gossip*>(pkt);
+            if (eventTrace)
+                eventTrace->record(TRACE_RECEIVE, TRACE_NO_MACHINE, 0, WIRE_GOSSIP, g->getId());
+            pool->add(MSG_DATA, Envelope::owning(g));
+            return true;
+        }
+        case WIRE_HELLO: {
+            GossipHello* gh = static_cast<GossipHello*>(pkt);
+            if (eventTrace)
+                eventTrace->record(TRACE_RECEIVE, TRACE_NO_MACHINE, 0, WIRE_HELLO, gh->getHeartbeat());
+            pool->add(MSG_HELLO, Envelope::owning(gh));
+            return true;
+        }
+        case WIRE_IHAVE: {
+            GossipIHave* ih = static_cast<GossipIHave*>(pkt);
+            if (eventTrace)
+                eventTrace->record(TRACE_RECEIVE, TRACE_NO_MACHINE, 0, WIRE_IHAVE, ih->getId());
+            pool->add(MSG_IHAVE, Envelope::owning(ih));
+            return true;
+        }
+        case WIRE_GRAFT: {
+            GossipGraft* gg = static_cast<GossipGraft*>(pkt);
+            if (eventTrace)
+                eventTrace->record(TRACE_RECEIVE, TRACE_NO_MACHINE, 0, WIRE_GRAFT, gg->getId());
+            pool->add(MSG_GRAFT, Envelope::owning(gg));
+            return true;
+        }
+        case WIRE_PRUNE:
+            if (eventTrace)
+                eventTrace->record(TRACE_RECEIVE, TRACE_NO_MACHINE, 0, WIRE_PRUNE, 0);
+            pool->add(MSG_PRUNE, Envelope::owning(static_cast<GossipPrune*>(pkt)));
+            return true;
+        case WIRE_CODED: {
+            GossipCoded* gc = static_cast<GossipCoded*>(pkt);
+            if (eventTrace)
+                eventTrace->record(TRACE_RECEIVE, TRACE_NO_MACHINE, 0, WIRE_CODED, gc->getId());
+            pool->add(MSG_CODED, Envelope::owning(gc));
+            return true;
+        }
+        default:
+            return false;
+    }
 }
 
 bool GossipPush::sayHello()
@@ -156,72 +294,676 @@ bool GossipPush::sayHello()
 //
 //    }
 
-    for ( L3Address& addr : possibleNeighbors ) {
-        GossipHello* pkt = new GossipHello("Hello");
-        pkt->setId(myself.c_str());
-        socket.sendTo(pkt, addr, destinationPort);
+    heartbeat++;
+    double now = SIMTIME_DBL(simTime());
+    if (firstHello < 0)
+        firstHello = now;
+
+    helloPrototype.setName("Hello");
+    helloPrototype.setId(myself.c_str());
+    helloPrototype.setHeartbeat(heartbeat);
+    helloPrototype.setTimestamp(now);
+    helloPrototype.setEchoTimestamp(-1);
+    helloPrototype.setEchoDelay(0);
+    helloPrototype.setCluster(myCluster);
+    helloPrototype.setAggregator(aggregatorRole);
+    if (bootstrapSeeds || hierarchical)
+        sampleMembers();
+
+    vector<L3Address> targets;
+    helloTargets(targets);
+    for ( L3Address& addr : targets ) {
+        auto id = memberIds.find(addr);
+        // our gossip already told it we are alive
+        if (piggybackMembership && id != memberIds.end() && addresses[id->second].lastSent >= 0
+                && now - addresses[id->second].lastSent < helloInterval)
+            continue;
+
+        GossipHello* pkt = helloPackets.copyOf(helloPrototype);
+        if (id != memberIds.end()) {
+            GossipMember& m = addresses[id->second];
+            pkt->setEchoTimestamp(m.peerTimestamp);
+            pkt->setEchoDelay(now - m.peerTimestampArrival);
+        }
+        pkt->setByteLength(wireLength(pkt));
+        if (eventTrace)
+            eventTrace->record(TRACE_SEND, TRACE_NO_MACHINE, 0, WIRE_HELLO, heartbeat);
+        sendPacket(pkt, addr);
     }
 
     return true;
 }
 
+void GossipPush::helloTargets(vector<L3Address>& targets)
+{
+    targets.clear();
+
+    if (hierarchical) {
+        for (auto& a : addresses) {
+            if (a.second.cluster < 0 || inScope(a.second, SCOPE_CLUSTER) || (aggregatorRole && a.second.aggregator))
+                targets.push_back(a.second.address);
+        }
+        // a single hello to a few of the others each round, they answer if we matter to them
+        vector<const L3Address*> unknown;
+        for (L3Address& addr : possibleNeighbors) {
+            if (memberIds.find(addr) == memberIds.end() && contacted.find(addr) == contacted.end())
+                unknown.push_back(&addr);
+        }
+        unsigned int n = std::min((unsigned int)std::max(discoverySample, 0), (unsigned int)unknown.size());
+        for (unsigned int k = 0 ; k < n ; k++) {
+            std::swap(unknown[k], unknown[intuniform(k, unknown.size() - 1)]);
+            contacted.insert(*unknown[k]);
+            targets.push_back(*unknown[k]);
+        }
+    }
+    else if (bootstrapSeeds) {
+        for (auto& a : addresses)
+            targets.push_back(a.second.address);
+        for (L3Address& seed : possibleNeighbors) {
+            if (memberIds.find(seed) == memberIds.end())
+                targets.push_back(seed);
+        }
+    }
+    else {
+        targets = possibleNeighbors;
+    }
+}
+
+void GossipPush::sampleMembers()
+{
+    vector<const std::pair<const string, GossipMember>*> sample;
+    for (auto& a : addresses)
+        sample.push_back(&a);
+
+    unsigned int n = std::min((unsigned int)std::max(helloSampleSize, 0), (unsigned int)sample.size());
+    for (unsigned int k = 0 ; k < n ; k++) {
+        int j = intuniform(k, sample.size() - 1);
+        std::swap(sample[k], sample[j]);
+    }
+
+    helloPrototype.setSampleIdsArraySize(n);
+    helloPrototype.setSampleAddressesArraySize(n);
+    helloPrototype.setSampleHeartbeatsArraySize(n);
+    for (unsigned int k = 0 ; k < n ; k++) {
+        helloPrototype.setSampleIds(k, sample[k]->first.c_str());
+        helloPrototype.setSampleAddresses(k, sample[k]->second.address.str().c_str());
+        helloPrototype.setSampleHeartbeats(k, sample[k]->second.heartbeat);
+    }
+}
+
+void GossipPush::sayGoodbye()
+{
+    // the members can forget us right away instead of waiting for the timeout
+    for (auto& a : addresses) {
+        GossipHello* pkt = new GossipHello("Goodbye");
+        pkt->setId(myself.c_str());
+        pkt->setHeartbeat(LEAVING);
+        pkt->setByteLength(wireLength(pkt));
+        sendPacket(pkt, a.second.address);
+    }
+}
+
+void GossipPush::expireMembers()
+{
+    if (!phiDetector && suspicionTimeout <= 0) return;
+
+    double now = SIMTIME_DBL(simTime());
+    for (auto it = addresses.begin(); it != addresses.end(); ) {
+        double silence = now - it->second.lastHeard;
+        bool dead;
+        if (phiDetector) {
+            // exponentially distributed arrivals: phi = -log10(P(no hello for 'silence'))
+            double phi = silence / it->second.meanInterval * 0.4342944819;
+            dead = phi >= phiThreshold;
+        }
+        else {
+            dead = silence > suspicionTimeout;
+        }
+
+        if (dead) {
+            EV_TRACE << "Member " << it->first << " has not been heard for " << silence << "s, forgetting it\n";
+            string id = it->first;
+            ++it;
+            forgetMember(id);
+            numExpiredMembers++;
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+void GossipPush::forgetMember(const string& id)
+{
+    auto it = addresses.find(id);
+    if (it != addresses.end()) {
+        int& last = tombstones[id];
+        last = std::max(last, it->second.heartbeat);
+        memberIds.erase(it->second.address);
+        eagerPeers.erase(it->second.address);
+        lazyPeers.erase(it->second.address);
+        addresses.erase(it);
+    }
+}
+
+bool GossipPush::inScope(const GossipMember& m, TargetScope scope)
+{
+    switch (scope) {
+        case SCOPE_CLUSTER:
+            return m.cluster == myCluster;
+        case SCOPE_AGGREGATORS:
+            return m.cluster != myCluster && m.aggregator;
+        default:
+            return true;
+    }
+}
+
+void GossipPush::selectTargets(vector<L3Address>& targets, TargetScope scope, int topic)
+{
+    targets.clear();
+
+    vector<GossipMember*> candidates;
+    for (auto& a : addresses) {
+        if (inScope(a.second, scope))
+            candidates.push_back(&a.second);
+    }
+
+    // the aggregators carry every topic between the clusters
+    if (topic == 0 || scope == SCOPE_AGGREGATORS) {
+        pickTargets(candidates, peerSelection == SELECT_ALL ? candidates.size() : nodesPerRound, targets);
+        return;
+    }
+
+    // subscribers first, a few other members keep the topic flowing to the parts of the network without any
+    auto split = std::stable_partition(candidates.begin(), candidates.end(), [topic] (GossipMember* m) {
+        return BloomFilter::mayContain(m->subscriptions, topic);
+    });
+    vector<GossipMember*> others(split, candidates.end());
+    candidates.erase(split, candidates.end());
+
+    int wanted, relays;
+    if (peerSelection == SELECT_ALL) {
+        wanted = candidates.size();
+        relays = (int)std::ceil(others.size() * relayFraction);
+    }
+    else {
+        relays = std::min((int)others.size(), (int)(nodesPerRound * relayFraction + 0.5));
+        wanted = nodesPerRound - relays;
+        if ((int)candidates.size() < wanted)
+            relays = std::min((int)others.size(), nodesPerRound - (int)candidates.size());
+    }
+    pickTargets(candidates, wanted, targets);
+    pickTargets(others, relays, targets);
+}
+
+void GossipPush::pickTargets(vector<GossipMember*>& candidates, int n, vector<L3Address>& targets)
+{
+    if (n >= (int)candidates.size()) {
+        for (GossipMember* m : candidates)
+            targets.push_back(m->address);
+        return;
+    }
+
+    int nearest = 0;
+    if (peerSelection == SELECT_RTT) {
+        nearest = n - (int)(n * randomLinkFraction + 0.5);
+        // unknown round trip times go last
+        std::partial_sort(candidates.begin(), candidates.begin() + nearest, candidates.end(), [] (GossipMember* a, GossipMember* b) {
+            if (a->srtt < 0) return false;
+            if (b->srtt < 0) return true;
+            return a->srtt < b->srtt;
+        });
+    }
+
+    // the remaining ones are picked at random among the other members
+    for (int k = nearest ; k < n ; k++) {
+        int j = intuniform(k, candidates.size() - 1);
+        std::swap(candidates[k], candidates[j]);
+    }
+
+    for (int k = 0 ; k < n ; k++)
+        targets.push_back(candidates[k]->address);
+}
+
 bool GossipPush::gossiping()
+{
+    return gossipRound(hierarchical ? SCOPE_CLUSTER : SCOPE_ALL, true);
+}
+
+bool GossipPush::relaying()
+{
+    // the rounds are counted by the gossip inside the cluster that follows
+    return gossipRound(SCOPE_AGGREGATORS, false);
+}
+
+bool GossipPush::gossipRound(TargetScope scope, bool countRound)
 {
     bool r = false;
-    auto it = std::find_if(infections.begin(), infections.end(), [] (GossipInfection f) {
-       return f.roundsLeft > 0;
-    });
+    unsigned int first = pendingSends.size();
+    vector<L3Address> targets;
 
-    while (it != infections.end()) {
+    for (unsigned int k = 0 ; k < infections.size() ; k++) {
+        GossipInfection& infection = infections[k];
+        if (infection.roundsLeft <= 0) continue;
 
-        for (std::map<string,L3Address>::iterator it2=addresses.begin(); it2!=addresses.end(); ++it2) {
-            L3Address addr = it2->second;
-            Gossip* pkt = new Gossip("");
-            pkt->setId(it->idMsg);
-            pkt->setSource(it->source.c_str());
-            pkt->setMsg(it->text.c_str());
-            socket.sendTo(pkt, addr, destinationPort);
-        }
+        double priority = 0;
+        if (gossipPriority == PRIORITY_NEWEST)
+            priority = -infection.learnt;
+        else if (gossipPriority == PRIORITY_FEWEST_ROUNDS)
+            priority = roundRatio - infection.roundsLeft;
+
+        selectTargets(targets, scope, infection.topic);
+        queueGossip(infection, targets, priority);
 
         r = true;
-        it->roundsLeft--;
+        if (countRound)
+            infection.roundsLeft--;
+    }
+
+    flushGossip(first);
+
+    if (countRound && !plumtree)
+        compactInfections();
+
+    return r;
+}
+
+uint64_t GossipPush::infectionKey(const string& source, int id)
+{
+    // FNV-1a of the source and the id, a collision only costs a message of another topic
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : source)
+        h = (h ^ (uint8_t)c) * 0x100000001b3ULL;
+    for (int k = 0 ; k < 4 ; k++)
+        h = (h ^ (((uint32_t)id >> (8 * k)) & 0xff)) * 0x100000001b3ULL;
+    return h;
+}
+
+void GossipPush::compactInfections()
+{
+    // Plumtree keeps the payloads to answer the grafts, so this is push mode only
+    auto end = std::remove_if(infections.begin(), infections.end(), [this] (const GossipInfection& t) {
+        if (t.roundsLeft > 0 || t.coded || isSubscribed(t.topic))
+            return false;
+        relayedIds.insert(infectionKey(t.source, t.idMsg));
+        return true;
+    });
+    if (end != infections.end()) {
+        infections.erase(end, infections.end());
+        emit(infectionStoreSizeSignal, (long)infections.size());
+    }
+}
 
-        it = std::find_if(it, infections.end(), [] (GossipInfection f) {
-           return f.roundsLeft > 0;
+void GossipPush::prepareGossip(const GossipInfection& t)
+{
+    gossipPrototype.setName("");
+    gossipPrototype.setId(t.idMsg);
+    gossipPrototype.setSource(t.source.c_str());
+    gossipPrototype.setTopic(t.topic);
+    gossipPrototype.setPayloadLength(t.payloadLength);
+
+    if (piggybackMembership) {
+        // the heartbeat has to grow for the receivers to take the gossip as a sign of life
+        heartbeat++;
+        gossipPrototype.setSenderId(myself.c_str());
+        gossipPrototype.setSenderHeartbeat(heartbeat);
+
+        vector<const std::pair<const string, GossipMember>*> recent;
+        for (auto& a : addresses)
+            recent.push_back(&a);
+        unsigned int n = std::min((unsigned int)std::max(piggybackPeers, 0), (unsigned int)recent.size());
+        std::partial_sort(recent.begin(), recent.begin() + n, recent.end(), [] (const std::pair<const string, GossipMember>* a, const std::pair<const string, GossipMember>* b) {
+            return a->second.lastHeard > b->second.lastHeard;
         });
+        gossipPrototype.setRecentPeersArraySize(n);
+        gossipPrototype.setRecentHeartbeatsArraySize(n);
+        for (unsigned int k = 0 ; k < n ; k++) {
+            gossipPrototype.setRecentPeers(k, recent[k]->first.c_str());
+            gossipPrototype.setRecentHeartbeats(k, recent[k]->second.heartbeat);
+        }
     }
+    gossipPrototype.setByteLength(wireLength(&gossipPrototype));
+}
 
-    return r;
+GossipCoded* GossipPush::buildCoded(const GossipInfection& t)
+{
+    // a generation we hold something of, picked at random so they all spread
+    vector<int> held;
+    for (int g = 0 ; g < t.coded->getGenerations() ; g++) {
+        if (t.coded->getGeneration(g).getRank() > 0)
+            held.push_back(g);
+    }
+    int g = held[intuniform(0, held.size() - 1)];
+    const RlncGeneration& generation = t.coded->getGeneration(g);
+
+    // a fresh random combination of its rows, nonzero so no row is ignored
+    vector<uint8_t> mix(generation.getRank());
+    for (uint8_t& c : mix)
+        c = intuniform(1, 255);
+
+    GossipCoded* pkt = new GossipCoded("Coded");
+    pkt->setId(t.idMsg);
+    pkt->setSource(t.source.c_str());
+    pkt->setTotalLength(t.coded->getTotalLength());
+    pkt->setChunkSize(t.coded->getChunkSize());
+    pkt->setGenerationSize(t.coded->getGenerationSize());
+    pkt->setGeneration(g);
+    pkt->setPiece(generation.recode(mix));
+    pkt->setByteLength(wireLength(pkt));
+    return pkt;
+}
+
+void GossipPush::queueGossip(const GossipInfection& t, const vector<L3Address>& targets, double priority)
+{
+    if (t.coded) {
+        // every target gets a different combination
+        if (t.coded->getRank() > 0) {
+            for (const L3Address& to : targets)
+                pendingSends.push_back(PendingSend { buildCoded(t), WIRE_CODED, t.idMsg, to, priority });
+        }
+        return;
+    }
+
+    prepareGossip(t);
+    for (const L3Address& to : targets)
+        pendingSends.push_back(PendingSend { gossipPackets.copyOf(gossipPrototype), WIRE_GOSSIP, t.idMsg, to, priority });
+}
+
+void GossipPush::dropPending(PendingSend& p)
+{
+    if (p.wireType == WIRE_GOSSIP)
+        gossipPackets.recycle(static_cast<Gossip*>(p.pkt));
+    else
+        delete p.pkt;
+}
+
+void GossipPush::flushGossip(unsigned int first)
+{
+    if (gossipPriority != PRIORITY_FIFO && first < pendingSends.size()) {
+        // the packets already waiting are sorted, on a tie they stay ahead of the new ones
+        auto byPriority = [] (const PendingSend& a, const PendingSend& b) { return a.priority < b.priority; };
+        std::stable_sort(pendingSends.begin() + first, pendingSends.end(), byPriority);
+        std::inplace_merge(pendingSends.begin(), pendingSends.begin() + first, pendingSends.end(), byPriority);
+    }
+
+    // the budget could not keep up, forget the least important packets
+    while ((int)pendingSends.size() > maxPendingSends) {
+        dropPending(pendingSends.back());
+        pendingSends.pop_back();
+        numDroppedSends++;
+    }
+
+    sendPending();
+}
+
+void GossipPush::sendPending()
+{
+    while (!pendingSends.empty()) {
+        PendingSend& next = pendingSends.front();
+        double now = SIMTIME_DBL(simTime());
+        if (!sendBudget.consume(next.pkt->getByteLength(), now)) {
+            if (!sendTimer->isScheduled())
+                scheduleAt(simTime() + sendBudget.timeUntil(next.pkt->getByteLength(), now), sendTimer);
+            break;
+        }
+        if (eventTrace)
+            eventTrace->record(TRACE_SEND, TRACE_NO_MACHINE, 0, next.wireType, next.id);
+        if (piggybackMembership && next.wireType == WIRE_GOSSIP) {
+            auto id = memberIds.find(next.to);
+            if (id != memberIds.end())
+                addresses[id->second].lastSent = now;
+        }
+        sendPacket(next.pkt, next.to);
+        pendingSends.pop_front();
+    }
+    emit(pendingSendsSignal, (long)pendingSends.size());
+}
+
+GossipPush::GossipInfection* GossipPush::findInfection(const string& source, int id)
+{
+    for (GossipInfection& t : infections) {
+        if (t.idMsg == id && t.source == source)
+            return &t;
+    }
+    return nullptr;
+}
+
+void GossipPush::setEager(const L3Address& peer, bool eager)
+{
+    // links only exist towards members, they go away with forgetMember()
+    if (memberIds.find(peer) == memberIds.end()) return;
+
+    if (eager) {
+        lazyPeers.erase(peer);
+        eagerPeers.insert(peer);
+    }
+    else {
+        eagerPeers.erase(peer);
+        lazyPeers.insert(peer);
+    }
+}
+
+void GossipPush::sendPacket(cPacket* pkt, const L3Address& to)
+{
+    if (verifyWire && !checkEncoding(check_and_cast<GossipPacket*>(pkt)))
+        throw cRuntimeError("%s packet does not encode to its wire length of %ld bytes", pkt->getName(), (long)pkt->getByteLength());
+    socket.sendTo(pkt, to, destinationPort);
+}
+
+void GossipPush::plumtreeBroadcast(const GossipInfection& t, const L3Address* except)
+{
+    unsigned int first = pendingSends.size();
+    vector<L3Address> targets;
+    for (const L3Address& to : eagerPeers) {
+        if (except == nullptr || to != *except)
+            targets.push_back(to);
+    }
+    queueGossip(t, targets, 0);
+    flushGossip(first);
+
+    for (const L3Address& to : lazyPeers) {
+        if (except != nullptr && to == *except) continue;
+        GossipIHave* ih = new GossipIHave("IHave");
+        ih->setId(t.idMsg);
+        ih->setSource(t.source.c_str());
+        ih->setByteLength(wireLength(ih));
+        if (eventTrace)
+            eventTrace->record(TRACE_SEND, TRACE_NO_MACHINE, 0, WIRE_IHAVE, t.idMsg);
+        sendPacket(ih, to);
+    }
+}
+
+void GossipPush::plumtreeReceived(Gossip* g, bool fresh)
+{
+    L3Address sender = check_and_cast<UDPDataIndication *>(g->getControlInfo())->getSrcAddr();
+
+    if (fresh) {
+        setEager(sender, true);
+
+        auto it = missing.find(std::make_pair(string(g->getSource()), g->getId()));
+        if (it != missing.end()) {
+            cancelAndDelete(it->second.timer);
+            missing.erase(it);
+        }
+
+        GossipInfection* t = findInfection(g->getSource(), g->getId());
+        t->roundsLeft = 0;
+        plumtreeBroadcast(*t, &sender);
+    }
+    else {
+        // a redundant path, keep the link only for announcements
+        setEager(sender, false);
+        GossipPrune* gp = new GossipPrune("Prune");
+        gp->setByteLength(wireLength(gp));
+        if (eventTrace)
+            eventTrace->record(TRACE_SEND, TRACE_NO_MACHINE, 0, WIRE_PRUNE, 0);
+        sendPacket(gp, sender);
+    }
+}
+
+void GossipPush::processIHave(GossipIHave* ih)
+{
+    if (findInfection(ih->getSource(), ih->getId()) != nullptr) return;
+
+    L3Address sender = check_and_cast<UDPDataIndication *>(ih->getControlInfo())->getSrcAddr();
+    MissingInfection& m = missing[std::make_pair(string(ih->getSource()), ih->getId())];
+    m.announcers.push_back(sender);
+    if (m.announcers.size() == 1) {
+        m.timer = new cMessage("graftTimeout", GRAFT_TIMEOUT);
+        scheduleAt(simTime() + graftTimeout, m.timer);
+    }
+}
+
+void GossipPush::processGraft(GossipGraft* gg)
+{
+    L3Address sender = check_and_cast<UDPDataIndication *>(gg->getControlInfo())->getSrcAddr();
+    setEager(sender, true);
+
+    GossipInfection* t = findInfection(gg->getSource(), gg->getId());
+    if (t != nullptr) {
+        unsigned int first = pendingSends.size();
+        queueGossip(*t, vector<L3Address>(1, sender), 0);
+        flushGossip(first);
+    }
+}
+
+void GossipPush::processPrune(GossipPrune* gp)
+{
+    L3Address sender = check_and_cast<UDPDataIndication *>(gp->getControlInfo())->getSrcAddr();
+    setEager(sender, false);
+}
+
+void GossipPush::graftMissing(cMessage* timer)
+{
+    // the payload arrived while the timer waited in the pool, the entry went away with
+    // cancelAndDelete() and the timer may even be a new one at the same address
+    auto it = missing.begin();
+    while (it != missing.end() && it->second.timer != timer)
+        ++it;
+    if (it == missing.end() || timer->isScheduled())
+        return;
+
+    // ask the first announcer, the next one is tried if this one does not answer either
+    MissingInfection& m = it->second;
+    L3Address to = m.announcers.front();
+    m.announcers.erase(m.announcers.begin());
+    setEager(to, true);
+
+    GossipGraft* gg = new GossipGraft("Graft");
+    gg->setId(it->first.second);
+    gg->setSource(it->first.first.c_str());
+    gg->setByteLength(wireLength(gg));
+    if (eventTrace)
+        eventTrace->record(TRACE_SEND, TRACE_NO_MACHINE, 0, WIRE_GRAFT, gg->getId());
+    sendPacket(gg, to);
+
+    if (m.announcers.empty()) {
+        delete timer;
+        missing.erase(it);
+    }
+    else {
+        scheduleAt(simTime() + graftTimeout, timer);
+    }
+}
+
+void GossipPush::clearMissing()
+{
+    for (auto& m : missing)
+        cancelAndDelete(m.second.timer);
+    missing.clear();
+}
+
+void GossipPush::clearPending()
+{
+    for (PendingSend& p : pendingSends)
+        dropPending(p);
+    pendingSends.clear();
+    if (sendTimer)
+        cancelEvent(sendTimer);
 }
 
 void GossipPush::finish()
 {
+    dumpTrace();
+    delete eventTrace;
+    eventTrace = nullptr;
+
+    if (!interpreters.empty()) {
+        sampleMemory();
+        for (int k = 0 ; k <= MEMORY_CATEGORIES ; k++)
+            recordScalar((string("memoryPeak.") + memoryCategoryNames[k]).c_str(), memoryPeaks[k], "B");
+    }
+    if (memoryTimer)
+        cancelAndDelete(memoryTimer);
+    memoryTimer = nullptr;
+
+    recordScalar("droppedSends", numDroppedSends);
+    if (sm_proptocol) {
+        recordScalar("shedHellos", sm_proptocol->getPool()->getShed(MSG_HELLO));
+        recordScalar("shedData", sm_proptocol->getPool()->getShed(MSG_DATA));
+    }
+    recordScalar("expiredMembers", numExpiredMembers);
+    recordScalar("uselessPieces", numUselessPieces);
+
+    if (!snapshotOut.empty() && !interpreters.empty())
+        saveSnapshot(snapshotOut);
+
     if (ctrlMsg0)
         cancelAndDelete(ctrlMsg0);
     ctrlMsg0 = nullptr;
+
+    clearPending();
+    clearMissing();
+    if (sendTimer)
+        cancelAndDelete(sendTimer);
+    sendTimer = nullptr;
+
+    gossipPackets.clear();
+    helloPackets.clear();
+
+    leaveTickerBatch();
 }
 
 bool GossipPush::handleNodeStart(IDoneCallback *doneCallback)
 {
     ctrlMsg0->setKind(START);
-    scheduleAt(simTime() + 0.01, ctrlMsg0);
+    // random initial phase
+    double phase = startJitter > 0 ? uniform(0, startJitter) : 0;
+    scheduleAt(simTime() + startTime + phase, ctrlMsg0);
     return true;
 }
 
 bool GossipPush::handleNodeShutdown(IDoneCallback *doneCallback)
 {
+    sayGoodbye();
+
+    if (memoryTimer)
+        cancelEvent(memoryTimer);
+
     if (ctrlMsg0)
         cancelAndDelete(ctrlMsg0);
     ctrlMsg0 = nullptr;
 
+    clearPending();
+    clearMissing();
+
     return true;
 }
 
 void GossipPush::handleNodeCrash()
 {
+    dumpTrace();
+    leaveTickerBatch();
+
+    if (memoryTimer)
+        cancelEvent(memoryTimer);
+
     if (ctrlMsg0)
         cancelAndDelete(ctrlMsg0);
     ctrlMsg0 = nullptr;
+
+    clearPending();
+    clearMissing();
 }
 
 void GossipPush::processStart()
@@ -233,16 +975,117 @@ void GossipPush::processStart()
     if (isSource) {
         numMessages = par("numMessages");
         intervalAmongNewMessages = par("intervalAmongNewMessages").doubleValue();
+
+        string arrival = par("arrivalProcess").stdstringValue();
+        if (arrival == "poisson")
+            arrivalProcess = ARRIVAL_POISSON;
+        else if (arrival == "onoff")
+            arrivalProcess = ARRIVAL_ONOFF;
+        else if (arrival == "trace")
+            arrivalProcess = ARRIVAL_TRACE;
+        else
+            arrivalProcess = ARRIVAL_PERIODIC;
+        onDuration = par("onDuration").doubleValue();
+        offDuration = par("offDuration").doubleValue();
+
+        if (arrivalProcess == ARRIVAL_TRACE) {
+            loadTrace(par("traceFile").stringValue());
+            // the trace decides how many messages there are
+            if (numMessages < 0 || numMessages > (int)trace.size())
+                numMessages = trace.size();
+        }
     }
 
     nodesPerRound = par("nodesPerRound");
     roundRatio = par("roundRatio");
-
-    const char *destAddrs = par("addresses");
+    gossipInterval = par("gossipInterval").doubleValue();
+    helloInterval = par("helloInterval").doubleValue();
+    piggybackMembership = par("piggybackMembership");
+    hierarchical = par("hierarchical");
+    firstHello = -1;
+    if (hierarchical) {
+        myCluster = par("cluster");
+        if (myCluster < 0)
+            myCluster = getParentModule()->getIndex() / std::max(1, (int)par("clusterSize"));
+    }
+    piggybackPeers = par("piggybackPeers");
+
+    cStringTokenizer topics(par("subscriptions"));
+    while (topics.hasMoreTokens())
+        subscriptions.insert(atoi(topics.nextToken()));
+    BloomFilter filter(par("bloomBits"), par("bloomHashes"));
+    for (int topic : subscriptions)
+        filter.add(topic);
+    if (subscriptions.empty())
+        filter = BloomFilter();
+    helloPrototype.setSubscriptionFilterArraySize(filter.bytes().size());
+    for (unsigned int k = 0 ; k < filter.bytes().size() ; k++)
+        helloPrototype.setSubscriptionFilter(k, filter.bytes()[k]);
+    relayFraction = par("relayFraction").doubleValue();
+    tickJitter = par("tickJitter").doubleValue();
+    exponentialJitter = par("jitterDistribution").stdstringValue() == "exponential";
+
+    string selection = par("peerSelection").stdstringValue();
+    if (selection == "random")
+        peerSelection = SELECT_RANDOM;
+    else if (selection == "rtt")
+        peerSelection = SELECT_RTT;
+    else
+        peerSelection = SELECT_ALL;
+    randomLinkFraction = par("randomLinkFraction").doubleValue();
+
+    phiDetector = par("failureDetector").stdstringValue() == "phi";
+    suspicionTimeout = par("suspicionTimeout").doubleValue();
+    phiThreshold = par("phiThreshold").doubleValue();
+
+    // bps to bytes per second
+    sendBudget = TokenBucket(par("sendRate").doubleValue() / 8, par("burstSize").longValue(), SIMTIME_DBL(simTime()));
+    maxPendingSends = par("maxPendingSends");
+    gossipPackets.setCapacity(par("packetPoolSize").longValue());
+    helloPackets.setCapacity(par("packetPoolSize").longValue());
+    networkCoding = par("networkCoding").boolValue();
+    chunkSize = par("chunkSize");
+    generationSize = par("generationSize");
+    plumtree = par("disseminationMode").stdstringValue() == "plumtree";
+    graftTimeout = par("graftTimeout").doubleValue();
+    string priority = par("gossipPriority").stdstringValue();
+    if (priority == "newest")
+        gossipPriority = PRIORITY_NEWEST;
+    else if (priority == "fewestRounds")
+        gossipPriority = PRIORITY_FEWEST_ROUNDS;
+    else
+        gossipPriority = PRIORITY_FIFO;
+
+    verifyWire = par("verifyWire");
+
+    snapshotIn = par("snapshotIn").stdstringValue();
+    snapshotOut = par("snapshotOut").stdstringValue();
+
+    // with seeds the resolver only runs for a handful of names instead of the whole network
+    bootstrapSeeds = par("bootstrap").stdstringValue() == "seeds";
+    helloSampleSize = par("helloSampleSize");
+    const char *destAddrs = bootstrapSeeds ? par("seeds") : par("addresses");
     cStringTokenizer tokenizer(destAddrs);
     const char *token;
 
+    // hierarchical: only the members of our cluster, when it follows from the index, and a sample of the others
+    discoverySample = par("discoverySample");
+    bool clusterFromIndex = hierarchical && !bootstrapSeeds && (int)par("cluster") < 0;
+    int clusterSize = std::max(1, (int)par("clusterSize"));
+    vector<string> names, others;
     while ((token = tokenizer.nextToken()) != nullptr) {
+        if (!hierarchical || bootstrapSeeds || (clusterFromIndex && moduleIndex(token) >= 0 && moduleIndex(token) / clusterSize == myCluster))
+            names.push_back(token);
+        else
+            others.push_back(token);
+    }
+    for (unsigned int k = 0 ; k < others.size() && (int)k < discoverySample ; k++) {
+        std::swap(others[k], others[intuniform(k, others.size() - 1)]);
+        names.push_back(others[k]);
+    }
+
+    for (const string& name : names) {
+        token = name.c_str();
         L3Address result;
         L3AddressResolver().tryResolve(token, result);
         if (result.isUnspecified())
@@ -259,13 +1102,154 @@ void GossipPush::processStart()
     EV_TRACE << "Creating State Machines\n";
 
     sm_proptocol = createProtocolStateMachine();
+    limitPool();
     interpreters.push_back(new StateMachineInterpreter(sm_proptocol));
     interpreters.push_back(new StateMachineInterpreter(sm_tick_hello));
     interpreters.push_back(new StateMachineInterpreter(sm_tick_gossip));
     interpreters.push_back(new StateMachineInterpreter(sm_tick_new_gossip));
 
+    if (par("batchTickers").boolValue())
+        joinTickerBatch();
+
     EV_TRACE << "State Machines have been created\n";
 
+    if (memorySampleInterval > 0 && !memoryTimer->isScheduled())
+        scheduleAt(simTime() + memorySampleInterval, memoryTimer);
+
+    int traceCapacity = par("traceCapacity");
+    if (traceCapacity > 0 && eventTrace == nullptr) {
+        eventTrace = new EventTrace(traceCapacity);
+        for (unsigned int k = 0 ; k < interpreters.size() ; k++) {
+            StateMachine* sm = interpreters[k]->getStateMachine();
+            vector<string> states;
+            for (int i = 0 ; i < sm->countStates() ; i++)
+                states.push_back(sm->getState(i)->getName());
+            eventTrace->describeMachine(k, sm->getName(), states);
+            interpreters[k]->setTrace(eventTrace, k);
+        }
+    }
+
+    if (!snapshotIn.empty())
+        warmStarted = loadSnapshot(snapshotIn);
+
+}
+
+// a rough size for a node of a std::map or std::set holding 'value' bytes
+static size_t treeNode(size_t value)
+{
+    return value + 4 * sizeof(void*);
+}
+
+void GossipPush::measureMemory(long bytes[MEMORY_CATEGORIES + 1])
+{
+    size_t infectionBytes = infections.capacity() * sizeof(GossipInfection);
+    for (GossipInfection& t : infections) {
+        infectionBytes += t.source.capacity();
+        if (t.coded)
+            infectionBytes += sizeof(RlncPayload) + t.coded->footprint();
+    }
+    infectionBytes += relayedIds.size() * treeNode(sizeof(uint64_t));
+    bytes[MEMORY_INFECTIONS] = infectionBytes;
+
+    size_t memberBytes = (eagerPeers.size() + lazyPeers.size()) * treeNode(sizeof(L3Address));
+    for (auto& a : addresses)
+        memberBytes += treeNode(sizeof(a)) + a.first.capacity();
+    for (auto& m : memberIds)
+        memberBytes += treeNode(sizeof(m)) + m.second.capacity();
+    for (auto& t : tombstones)
+        memberBytes += treeNode(sizeof(t)) + t.first.capacity();
+    bytes[MEMORY_MEMBERS] = memberBytes;
+
+    bytes[MEMORY_NEIGHBORS] = possibleNeighbors.capacity() * sizeof(L3Address) + contacted.size() * treeNode(sizeof(L3Address));
+
+    size_t poolBytes = 0;
+    for (StateMachineInterpreter* i : interpreters) {
+        MessagePool* pool = i->getStateMachine()->getPool();
+        for (int k = 0 ; k < pool->count() ; k++) {
+            const Envelope& e = pool->getExtraData(k);
+            switch ((*pool)[k]) {
+                case MSG_DATA: poolBytes += sizeof(Gossip); break;
+                case MSG_HELLO: poolBytes += sizeof(GossipHello); break;
+                case MSG_IHAVE: poolBytes += sizeof(GossipIHave); break;
+                case MSG_GRAFT: poolBytes += sizeof(GossipGraft); break;
+                case MSG_PRUNE: poolBytes += sizeof(GossipPrune); break;
+                case MSG_CODED: poolBytes += sizeof(GossipCoded) + e.get<GossipCoded>()->getChunkSize(); break;
+                default: break;
+            }
+        }
+    }
+    bytes[MEMORY_POOL] = poolBytes;
+
+    size_t timerBytes = timers.size() * (treeNode(sizeof(std::pair<cMessage*, ITimeOut*>)) + sizeof(cMessage))
+            + listenersFootprint();
+    for (auto& m : missing)
+        timerBytes += treeNode(sizeof(m)) + m.first.first.capacity() + sizeof(cMessage)
+                + m.second.announcers.capacity() * sizeof(L3Address);
+    bytes[MEMORY_TIMERS] = timerBytes;
+
+    // the pools are here, the packets they hold are counted above
+    size_t machineBytes = interpreters.capacity() * sizeof(StateMachineInterpreter*);
+    for (StateMachineInterpreter* i : interpreters)
+        machineBytes += sizeof(StateMachineInterpreter) + i->getStateMachine()->footprint();
+    // our share of the batch
+    if (tickerBatch)
+        machineBytes += tickerBatch->footprint() * 3 / tickerBatch->count();
+    bytes[MEMORY_MACHINES] = machineBytes;
+
+    size_t sendBytes = pendingSends.size() * sizeof(PendingSend)
+            + gossipPackets.size() * sizeof(Gossip) + helloPackets.size() * sizeof(GossipHello);
+    for (PendingSend& p : pendingSends)
+        sendBytes += p.wireType == WIRE_CODED ? sizeof(GossipCoded) : sizeof(Gossip);
+    bytes[MEMORY_SENDS] = sendBytes;
+
+    bytes[MEMORY_CATEGORIES] = 0;
+    for (int k = 0 ; k < MEMORY_CATEGORIES ; k++)
+        bytes[MEMORY_CATEGORIES] += bytes[k];
+}
+
+void GossipPush::sampleMemory()
+{
+    long bytes[MEMORY_CATEGORIES + 1];
+    measureMemory(bytes);
+
+    for (int k = 0 ; k <= MEMORY_CATEGORIES ; k++) {
+        memoryVectors[k].record(bytes[k]);
+        memoryPeaks[k] = std::max(memoryPeaks[k], bytes[k]);
+    }
+    if (analyzer)
+        analyzer->memoryUsage(myself, bytes[MEMORY_CATEGORIES]);
+}
+
+static OverloadPolicy overloadPolicy(const string& name)
+{
+    if (name == "coalesce")
+        return COALESCE;
+    if (name == "dropOldest")
+        return DROP_OLDEST;
+    return DROP_NEWEST;
+}
+
+void GossipPush::limitPool()
+{
+    // interpreting() drains the protocol pool after every packet, so these limits only matter
+    // if the machine is moved less often than packets arrive; they are off by default
+    MessagePool* pool = sm_proptocol->getPool();
+
+    int capacity = par("helloPoolCapacity");
+    if (capacity >= 0) {
+        pool->setLimit(MSG_HELLO, capacity, overloadPolicy(par("helloOverload").stdstringValue()), [] (const Envelope& a, const Envelope& b) {
+            return strcmp(a.get<GossipHello>()->getId(), b.get<GossipHello>()->getId()) == 0;
+        });
+    }
+
+    capacity = par("dataPoolCapacity");
+    if (capacity >= 0) {
+        pool->setLimit(MSG_DATA, capacity, overloadPolicy(par("dataOverload").stdstringValue()), [] (const Envelope& a, const Envelope& b) {
+            Gossip* ga = a.get<Gossip>();
+            Gossip* gb = b.get<Gossip>();
+            return ga->getId() == gb->getId() && strcmp(ga->getSource(), gb->getSource()) == 0;
+        });
+    }
 }
 
 void GossipPush::registerListener(ITimeOut* listener, double afterElapsedTime)
@@ -280,6 +1264,310 @@ void GossipPush::registerListener(ITimeOut* listener, double afterElapsedTime)
 
 }
 
+void GossipPush::dumpTrace()
+{
+    if (eventTrace == nullptr) return;
+
+    string fileName = par("traceDumpDir").stdstringValue() + "/" + getParentModule()->getFullPath() + ".trace";
+    if (!eventTrace->dump(fileName, getParentModule()->getFullPath()))
+        EV_ERROR << "cannot write trace " << fileName << "\n";
+}
+
+string GossipPush::snapshotFileName(const string& dir)
+{
+    return dir + "/" + getParentModule()->getFullPath() + ".snap";
+}
+
+void GossipPush::saveSnapshot(const string& dir)
+{
+    string fileName = snapshotFileName(dir);
+    std::ofstream f(fileName.c_str(), std::ios::binary | std::ios::trunc);
+    BinaryWriter w(f);
+
+    w.writeVarint(SNAPSHOT_MAGIC);
+    w.writeVarint(SNAPSHOT_VERSION);
+    w.writeString(myself);
+    w.writeVarint(lastIdMsg);
+    w.writeSignedVarint(numMessages);
+    // the peers restore our heartbeat, hellos starting again from 1 would be taken as old
+    w.writeSignedVarint(heartbeat);
+
+    w.writeVarint(addresses.size());
+    for (auto& a : addresses) {
+        w.writeString(a.first);
+        w.writeString(a.second.address.str());
+        w.writeSignedVarint(a.second.heartbeat);
+        w.writeDouble(a.second.srtt);
+        w.writeSignedVarint(a.second.cluster);
+        w.writeVarint(a.second.aggregator ? 1 : 0);
+        w.writeVarint(a.second.subscriptions.size());
+        w.writeBytes(a.second.subscriptions.data(), a.second.subscriptions.size());
+    }
+
+    w.writeVarint(infections.size());
+    for (GossipInfection& t : infections) {
+        w.writeSignedVarint(t.idMsg);
+        w.writeString(t.source);
+        w.writeVarint(t.topic);
+        w.writeVarint(t.payloadLength);
+        w.writeSignedVarint(t.roundsLeft);
+        // a coded payload keeps the rows received so far, in each generation
+        w.writeVarint(t.coded ? 1 : 0);
+        if (t.coded) {
+            w.writeVarint(t.coded->getChunkSize());
+            w.writeVarint(t.coded->getGenerationSize());
+            for (int g = 0 ; g < t.coded->getGenerations() ; g++) {
+                const RlncGeneration& generation = t.coded->getGeneration(g);
+                w.writeVarint(generation.getRank());
+                for (int k = 0 ; k < generation.getRank() ; k++) {
+                    CodedPiece piece = generation.row(k);
+                    w.writeBytes(piece.coefficients.data(), piece.coefficients.size());
+                    w.writeBytes(piece.data->data(), piece.data->size());
+                }
+            }
+        }
+    }
+    w.writeVarint(relayedIds.size());
+    for (uint64_t key : relayedIds)
+        w.writeVarint(key);
+
+    // current state of each machine and, for tickers, the time left before the tick
+    w.writeVarint(interpreters.size());
+    for (StateMachineInterpreter* i : interpreters) {
+        State* current = i->getCurrent();
+        w.writeVarint(i->getStateMachine()->getStateIndex(current));
+        ITimeOut* listener = dynamic_cast<ITimeOut*>(current->getActions());
+        double left = -1;
+        for (auto& t : timers) {
+            if (listener != nullptr && t.second == listener)
+                left = SIMTIME_DBL(t.first->getArrivalTime() - simTime());
+        }
+        w.writeDouble(left);
+    }
+
+    if (!w.ok())
+        EV_ERROR << "cannot write snapshot " << fileName << "\n";
+}
+
+bool GossipPush::loadSnapshot(const string& dir)
+{
+    string fileName = snapshotFileName(dir);
+    std::ifstream f(fileName.c_str(), std::ios::binary);
+    if (!f) {
+        EV_ERROR << "cannot open snapshot " << fileName << ", doing a cold start\n";
+        return false;
+    }
+    BinaryReader r(f);
+
+    if (r.readVarint() != SNAPSHOT_MAGIC || r.readVarint() != SNAPSHOT_VERSION || r.readString() != myself) {
+        EV_ERROR << "snapshot " << fileName << " does not belong to " << myself << ", doing a cold start\n";
+        return false;
+    }
+
+    int lastId = r.readVarint();
+    int pendingMessages = r.readSignedVarint();
+    int lastHeartbeat = r.readSignedVarint();
+
+    // silence is counted from the warm start
+    map<string, GossipMember> restoredAddresses;
+    for (uint64_t n = r.readVarint() ; r.ok() && n > 0 ; n--) {
+        string id = r.readString();
+        GossipMember m;
+        m.address.tryParse(r.readString().c_str());
+        m.heartbeat = r.readSignedVarint();
+        m.directHeartbeat = -1;
+        m.lastHeard = SIMTIME_DBL(simTime());
+        m.meanInterval = helloInterval;
+        m.srtt = r.readDouble();
+        m.peerTimestamp = -1;
+        m.peerTimestampArrival = 0;
+        m.lastSent = -1;
+        m.cluster = r.readSignedVarint();
+        m.aggregator = r.readVarint() != 0;
+        // the count is not trusted to size the filter before its bytes are read
+        for (uint64_t b = r.readVarint() ; r.ok() && b > 0 ; b--) {
+            uint8_t byte = 0;
+            r.readBytes(&byte, 1);
+            m.subscriptions.push_back(byte);
+        }
+        restoredAddresses.insert(std::pair<string, GossipMember>(id, m));
+    }
+
+    vector<GossipInfection> restoredInfections;
+    for (uint64_t n = r.readVarint() ; r.ok() && n > 0 ; n--) {
+        GossipInfection t;
+        t.idMsg = r.readSignedVarint();
+        t.source = r.readString();
+        t.learnt = SIMTIME_DBL(simTime());
+        t.topic = r.readVarint();
+        t.payloadLength = r.readVarint();
+        t.roundsLeft = r.readSignedVarint();
+        if (r.readVarint() != 0) {
+            int chunk = r.readVarint();
+            int generationSize = r.readVarint();
+            if (!r.ok() || chunk <= 0 || generationSize <= 0) {
+                EV_ERROR << "snapshot " << fileName << " is corrupted, doing a cold start\n";
+                return false;
+            }
+            t.coded = std::make_shared<RlncPayload>(t.payloadLength, chunk, generationSize);
+            for (int g = 0 ; r.ok() && g < t.coded->getGenerations() ; g++) {
+                RlncGeneration& generation = t.coded->getGeneration(g);
+                for (uint64_t rank = r.readVarint() ; r.ok() && rank > 0 ; rank--) {
+                    CodedPiece piece;
+                    piece.coefficients.resize(generation.getK());
+                    r.readBytes(piece.coefficients.data(), piece.coefficients.size());
+                    std::shared_ptr< vector<uint8_t> > data = std::make_shared< vector<uint8_t> >(chunk);
+                    r.readBytes(data->data(), data->size());
+                    piece.data = data;
+                    generation.add(piece);
+                }
+            }
+        }
+        restoredInfections.push_back(t);
+    }
+    std::set<uint64_t> restoredRelayed;
+    for (uint64_t n = r.readVarint() ; r.ok() && n > 0 ; n--)
+        restoredRelayed.insert(r.readVarint());
+
+    vector<int> states;
+    vector<double> timeLeft;
+    if (r.readVarint() != interpreters.size()) {
+        EV_ERROR << "snapshot " << fileName << " has a different set of state machines, doing a cold start\n";
+        return false;
+    }
+    for (StateMachineInterpreter* i : interpreters) {
+        int idx = r.readVarint();
+        if (idx >= i->getStateMachine()->countStates()) {
+            EV_ERROR << "snapshot " << fileName << " is corrupted, doing a cold start\n";
+            return false;
+        }
+        states.push_back(idx);
+        timeLeft.push_back(r.readDouble());
+    }
+
+    if (!r.ok()) {
+        EV_ERROR << "snapshot " << fileName << " is truncated, doing a cold start\n";
+        return false;
+    }
+
+    // everything was read, it is safe to modify the node
+    lastIdMsg = lastId;
+    if (isSource)
+        numMessages = pendingMessages;
+    heartbeat = lastHeartbeat;
+    addresses = restoredAddresses;
+    memberIds.clear();
+    eagerPeers.clear();
+    lazyPeers.clear();
+    for (auto& a : addresses) {
+        memberIds[a.second.address] = a.first;
+        eagerPeers.insert(a.second.address);
+    }
+    infections = restoredInfections;
+    relayedIds = restoredRelayed;
+    for (unsigned int k = 0 ; k < interpreters.size() ; k++) {
+        StateMachine* sm = interpreters[k]->getStateMachine();
+        State* current = sm->getState(states[k]);
+        interpreters[k]->setCurrent(current);
+        ITimeOut* listener = dynamic_cast<ITimeOut*>(current->getActions());
+        if (listener != nullptr && timeLeft[k] >= 0)
+            GossipPush::registerListener(listener, timeLeft[k]);
+    }
+
+    EV_TRACE << "Warm start of " << myself << " from " << fileName << " with " << addresses.size() << " members\n";
+
+    return true;
+}
+
+double GossipPush::tickDelay(double interval)
+{
+    if (tickJitter <= 0)
+        return interval;
+    // both keep the mean interval, a tick is never scheduled in the past
+    double d = exponentialJitter ? interval - tickJitter + exponential(tickJitter) : interval + uniform(-tickJitter, tickJitter);
+    return std::max(0.0, d);
+}
+
+double GossipPush::nextArrival()
+{
+    double now = SIMTIME_DBL(simTime());
+
+    switch (arrivalProcess) {
+        case ARRIVAL_POISSON:
+            return exponential(intervalAmongNewMessages);
+        case ARRIVAL_ONOFF: {
+            if (onPeriodEnd < 0)
+                onPeriodEnd = now + exponential(onDuration);
+            double t = now + exponential(intervalAmongNewMessages);
+            // arrivals falling in a silent period move to the next active one
+            while (t > onPeriodEnd) {
+                double start = onPeriodEnd + exponential(offDuration);
+                onPeriodEnd = start + exponential(onDuration);
+                t = start + exponential(intervalAmongNewMessages);
+            }
+            return t - now;
+        }
+        case ARRIVAL_TRACE:
+            if (traceArmed < trace.size())
+                return std::max(0.0, trace[traceArmed++].time - now);
+            // the trace is over, numMessages is already 0
+            return intervalAmongNewMessages;
+        default:
+            return intervalAmongNewMessages;
+    }
+}
+
+void GossipPush::loadTrace(const char* fileName)
+{
+    std::ifstream f(fileName);
+    if (!f) {
+        EV_ERROR << "cannot open trace file " << fileName << "\n";
+        return;
+    }
+
+    string line;
+    while (std::getline(f, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        TraceEntry e;
+        if (!(fields >> e.time))
+            continue;
+        if (!(fields >> e.payloadLength))
+            e.payloadLength = par("payloadSize").longValue();
+        trace.push_back(e);
+    }
+
+    std::stable_sort(trace.begin(), trace.end(), [] (const TraceEntry& a, const TraceEntry& b) {
+        return a.time < b.time;
+    });
+
+    EV_TRACE << "Trace " << fileName << " has " << trace.size() << " messages\n";
+}
+
+void GossipPush::joinTickerBatch()
+{
+    // a restart brings new tickers
+    leaveTickerBatch();
+
+    cModule* network = getSimulation()->getSystemModule();
+    TickerBatch* shared = dynamic_cast<TickerBatch*>(network->findObject("tickerBatch", false));
+    if (shared == nullptr) {
+        cContextSwitcher context(network);
+        shared = new TickerBatch(sm_tick_hello);
+    }
+    tickerBatch = &shared->batch;
+    for (StateMachine* sm : { sm_tick_hello, sm_tick_gossip, sm_tick_new_gossip })
+        tickerSlots.push_back(tickerBatch->add(sm, getId()));
+}
+
+void GossipPush::leaveTickerBatch()
+{
+    for (int slot : tickerSlots)
+        tickerBatch->remove(slot);
+    tickerSlots.clear();
+    tickerBatch = nullptr;
+}
+
 void GossipPush::interpreting()
 {
     bool b;
@@ -288,42 +1576,276 @@ void GossipPush::interpreting()
         for (StateMachineInterpreter* i : interpreters) {
             b = b | i->move();
         }
+        if (tickerBatch)
+            b = tickerBatch->step(getId()) || b;
     } while (b);
 }
 
-void GossipPush::addNewAddress(string id)
+void GossipPush::addNewAddress(string id, int heartbeat, const L3Address* address, bool secondHand)
 {
-    if (myself != id) {
-        L3Address result;
-        L3AddressResolver().tryResolve(id.c_str(), result);
-        auto it = addresses.find(id);
-        if (it == addresses.end()) {
-            EV_TRACE << "Hello from " << id << "\n";
-            addresses.insert(std::pair<string, L3Address>(id, result));
+    if (myself == id) return;
+
+    auto it = addresses.find(id);
+    if (heartbeat == LEAVING) {
+        if (it != addresses.end()) {
+            EV_TRACE << "Goodbye from " << id << "\n";
+            forgetMember(id);
+        }
+        return;
+    }
+
+    double now = SIMTIME_DBL(simTime());
+    if (it == addresses.end()) {
+        // peers that have not expired it yet would bring a dead member back forever
+        auto dead = tombstones.find(id);
+        if (secondHand && dead != tombstones.end() && heartbeat <= dead->second)
+            return;
+
+        GossipMember m;
+        if (address)
+            m.address = *address;
+        else if (!bootstrapSeeds)
+            L3AddressResolver().tryResolve(id.c_str(), m.address);
+        else
+            return; // we cannot tell where it is without asking the resolver
+
+        m.heartbeat = heartbeat;
+        m.directHeartbeat = secondHand ? -1 : heartbeat;
+        m.lastHeard = now;
+        m.meanInterval = helloInterval;
+        m.peerTimestamp = -1;
+        m.peerTimestampArrival = 0;
+        m.srtt = -1;
+        m.lastSent = -1;
+        m.cluster = -1;
+        m.aggregator = false;
+        EV_TRACE << "Hello from " << id << "\n";
+        if (dead != tombstones.end())
+            tombstones.erase(dead);
+        addresses.insert(std::pair<string, GossipMember>(id, m));
+        memberIds[m.address] = id;
+        // new links start eager, Plumtree prunes the redundant ones
+        eagerPeers.insert(m.address);
+    }
+    else if (secondHand) {
+        // only the member itself can show it is alive, otherwise it would never expire
+        it->second.heartbeat = std::max(it->second.heartbeat, heartbeat);
+    }
+    else if (heartbeat > it->second.directHeartbeat) {
+        // an old hello that arrives late says nothing about the member being alive,
+        // the second hand news may have told us about this heartbeat before the member did
+        it->second.meanInterval = 0.9 * it->second.meanInterval + 0.1 * (now - it->second.lastHeard);
+        it->second.heartbeat = std::max(it->second.heartbeat, heartbeat);
+        it->second.directHeartbeat = heartbeat;
+        it->second.lastHeard = now;
+    }
+}
+
+void GossipPush::processHello(GossipHello* gh)
+{
+    UDPDataIndication *ctrl = check_and_cast<UDPDataIndication *>(gh->getControlInfo());
+    L3Address sender = ctrl->getSrcAddr();
+
+    if (hierarchical && gh->getHeartbeat() != LEAVING && gh->getCluster() >= 0 && gh->getCluster() != myCluster
+            && !(aggregatorRole && gh->getAggregator())) {
+        // other clusters only matter between aggregators
+        if (addresses.find(gh->getId()) != addresses.end())
+            forgetMember(gh->getId());
+        contacted.insert(sender);
+        return;
+    }
+
+    if (bootstrapSeeds || hierarchical) {
+        addNewAddress(gh->getId(), gh->getHeartbeat(), &sender);
+
+        for (unsigned int k = 0 ; k < gh->getSampleIdsArraySize() ; k++) {
+            L3Address address;
+            if (!address.tryParse(gh->getSampleAddresses(k)))
+                continue;
+            // the sender may not have expired a member we already forgot
+            auto dead = tombstones.find(gh->getSampleIds(k));
+            if (dead != tombstones.end() && gh->getSampleHeartbeats(k) <= dead->second)
+                continue;
+            if (hierarchical && addresses.find(gh->getSampleIds(k)) == addresses.end()) {
+                // we do not know its cluster yet, it gets a discovery hello
+                if (address != myAddress && std::find(possibleNeighbors.begin(), possibleNeighbors.end(), address) == possibleNeighbors.end())
+                    possibleNeighbors.push_back(address);
+                continue;
+            }
+            addNewAddress(gh->getSampleIds(k), gh->getSampleHeartbeats(k), &address, true);
         }
     }
+    else {
+        addNewAddress(gh->getId(), gh->getHeartbeat());
+    }
+
+    auto it = addresses.find(gh->getId());
+    if (it == addresses.end()) return;
+
+    GossipMember& m = it->second;
+    double now = SIMTIME_DBL(simTime());
+    m.cluster = gh->getCluster();
+    m.aggregator = gh->getAggregator();
+    m.subscriptions.resize(gh->getSubscriptionFilterArraySize());
+    for (unsigned int k = 0 ; k < m.subscriptions.size() ; k++)
+        m.subscriptions[k] = gh->getSubscriptionFilter(k);
+    m.peerTimestamp = gh->getTimestamp();
+    m.peerTimestampArrival = now;
+
+    if (gh->getEchoTimestamp() >= 0) {
+        // the time the member held our timestamp is not part of the trip
+        double rtt = now - gh->getEchoTimestamp() - gh->getEchoDelay();
+        m.srtt = m.srtt < 0 ? rtt : 0.875 * m.srtt + 0.125 * rtt;
+    }
+}
+
+void GossipPush::processMembership(Gossip* g)
+{
+    if (g->getSenderId()[0] == '\0') return;
+
+    UDPDataIndication *ctrl = check_and_cast<UDPDataIndication *>(g->getControlInfo());
+    L3Address sender = ctrl->getSrcAddr();
+    // in hierarchical mode the hellos decide who is a member, the gossip only refreshes them
+    if (!hierarchical || addresses.find(g->getSenderId()) != addresses.end())
+        addNewAddress(g->getSenderId(), g->getSenderHeartbeat(), &sender);
+    // second hand news, forgotten members are only taken back with a heartbeat newer than their tombstone
+    for (unsigned int k = 0 ; k < g->getRecentPeersArraySize() ; k++) {
+        if (!hierarchical || addresses.find(g->getRecentPeers(k)) != addresses.end())
+            addNewAddress(g->getRecentPeers(k), g->getRecentHeartbeats(k), nullptr, true);
+    }
+}
+
+bool GossipPush::electAggregator()
+{
+    if (!hierarchical) return false;
+
+    // by module index, as strings "host[10]" would come before "host[2]"
+    auto lowest = std::make_pair(moduleIndex(myself), myself);
+    bool heard = false;
+    for (auto& a : addresses) {
+        if (a.second.cluster != myCluster) continue;
+        heard = true;
+        lowest = std::min(lowest, std::make_pair(moduleIndex(a.first), a.first));
+    }
+
+    // before the members answer every node would elect itself and flood the other clusters,
+    // only a node still alone after a few hello intervals takes the role with an empty view
+    double waited = firstHello < 0 ? 0 : SIMTIME_DBL(simTime()) - firstHello;
+    if (waited < (heard ? 1 : 3) * helloInterval)
+        return false;
+
+    bool elected = lowest.second == myself;
+    if (elected == aggregatorRole) return false;
+    aggregatorRole = elected;
+    return true;
+}
 
+void GossipPush::promote()
+{
+    EV_TRACE << myself << " is now the aggregator of cluster " << myCluster << "\n";
+    // 'contacted' is kept, starting the discovery again would send a hello to every address we know;
+    // the other aggregators are found by the discovery still to come, ours and theirs
+}
 
+void GossipPush::resign()
+{
+    EV_TRACE << myself << " is no longer the aggregator of cluster " << myCluster << "\n";
+
+    // the other aggregators forget us when they see we are not one of them anymore
+    helloPrototype.setName("Hello");
+    helloPrototype.setId(myself.c_str());
+    helloPrototype.setHeartbeat(++heartbeat);
+    helloPrototype.setTimestamp(SIMTIME_DBL(simTime()));
+    helloPrototype.setEchoTimestamp(-1);
+    helloPrototype.setEchoDelay(0);
+    helloPrototype.setCluster(myCluster);
+    helloPrototype.setAggregator(false);
+    helloPrototype.setSampleIdsArraySize(0);
+    helloPrototype.setSampleAddressesArraySize(0);
+    helloPrototype.setSampleHeartbeatsArraySize(0);
+
+    vector<string> others;
+    for (auto& a : addresses) {
+        if (a.second.cluster >= 0 && a.second.cluster != myCluster)
+            others.push_back(a.first);
+    }
+    for (string& id : others) {
+        L3Address addr = addresses[id].address;
+        GossipHello* pkt = helloPackets.copyOf(helloPrototype);
+        pkt->setByteLength(wireLength(pkt));
+        sendPacket(pkt, addr);
+        forgetMember(id);
+        contacted.insert(addr);
+    }
 }
 
-void GossipPush::addNewInfection(Gossip* g)
+bool GossipPush::addNewInfection(Gossip* g)
 {
     bool exists = std::any_of(infections.begin(), infections.end(), [&](GossipInfection t) {
         return (g->getId() == t.idMsg) && (g->getSource() == t.source);
-    });
+    }) || relayedIds.count(infectionKey(g->getSource(), g->getId())) > 0;
+
+    if (analyzer)
+        analyzer->messageReceived(g->getSource(), g->getId(), exists);
 
     if (!exists) {
         GossipInfection t;
         t.idMsg = g->getId();
         t.roundsLeft = roundRatio;
+        t.learnt = SIMTIME_DBL(simTime());
         t.source = g->getSource();
-        t.text = g->getMsg();
+        t.topic = g->getTopic();
+        t.payloadLength = g->getPayloadLength();
         infections.push_back(t);
+        emit(infectionStoreSizeSignal, (long)infections.size());
 
         UDPDataIndication *ctrl = check_and_cast<UDPDataIndication *>(g->getControlInfo());
 
-        EV_TRACE << "A new foreign message : '"  <<  t.text << "' from " << t.source << " through "<< ctrl->getSrcAddr() << "\n";
+        EV_TRACE << "A new foreign message of "  <<  t.payloadLength << " bytes from " << t.source << " through "<< ctrl->getSrcAddr() << "\n";
+    }
+
+    return !exists;
+}
+
+bool GossipPush::addCodedPiece(GossipCoded* gc)
+{
+    GossipInfection* t = findInfection(gc->getSource(), gc->getId());
+
+    if (t == nullptr) {
+        if (gc->getChunkSize() <= 0 || gc->getGenerationSize() <= 0)
+            return false;
+        GossipInfection n;
+        n.idMsg = gc->getId();
+        n.source = gc->getSource();
+        n.learnt = SIMTIME_DBL(simTime());
+        n.topic = 0;
+        n.payloadLength = gc->getTotalLength();
+        n.coded = std::make_shared<RlncPayload>(gc->getTotalLength(), gc->getChunkSize(), gc->getGenerationSize());
+        n.roundsLeft = roundRatio * n.coded->getK();
+        infections.push_back(n);
+        emit(infectionStoreSizeSignal, (long)infections.size());
+        t = &infections.back();
+    }
+    else if (!t->coded || t->coded->isComplete()) {
+        if (analyzer)
+            analyzer->messageReceived(gc->getSource(), gc->getId(), true);
+        return false;
+    }
+
+    int g = gc->getGeneration();
+    if (g < 0 || g >= t->coded->getGenerations() || !t->coded->getGeneration(g).add(gc->getPiece())) {
+        numUselessPieces++;
+        return false;
     }
+
+    if (t->coded->isComplete()) {
+        EV_TRACE << "Decoded a message of " << t->payloadLength << " bytes from " << t->source << "\n";
+        if (t->coded->decode() != codedContent(t->idMsg, t->payloadLength))
+            EV_ERROR << "the message " << t->idMsg << " from " << t->source << " did not decode to what was sent\n";
+        if (analyzer)
+            analyzer->messageReceived(t->source, t->idMsg, false);
+    }
+    return true;
 }
 
 class wActions : public StateActions {
@@ -332,7 +1854,7 @@ private:
     StateMachine* sm_newGossip;
 public:
     wActions(StateMachine* t_hello, StateMachine* t_newGossip):sm_hello(t_hello), sm_newGossip(t_newGossip) {};
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) {
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
         sm_hello->reportMessage(MSG_ACTIVATE);
         sm_newGossip->reportMessage(MSG_ACTIVATE);
     }
@@ -344,10 +1866,9 @@ private:
     StateMachine* sm_Gossip;
 public:
     ngActions(GossipPush* gpp, StateMachine* t_Gossip):gp(gpp), sm_Gossip(t_Gossip) {};
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) {
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
         gp->newGossip();
         sm_Gossip->reportMessage(MSG_ACTIVATE);
-        stateMachine->reportMessage(MSG_TRUE);
     }
 };
 
@@ -356,9 +1877,9 @@ private:
     GossipPush* gp;
 public:
     hActions(GossipPush* gpp):gp(gpp){};
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) {
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        gp->expireMembers();
         gp->sayHello();
-        stateMachine->reportMessage(MSG_TRUE);
     }
 };
 
@@ -367,8 +1888,52 @@ private:
     GossipPush* gp;
 public:
     gActions(GossipPush* gpp):gp(gpp){};
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) {
-        stateMachine->reportMessage(gp->isInfected()? MSG_FULL_MAILBOX : MSG_EMPTY_MAILBOX);
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        if (!gp->isInfected())
+            stateMachine->reportMessage(MSG_EMPTY_MAILBOX);
+        else
+            stateMachine->reportMessage(gp->isAggregator() ? MSG_RELAY : MSG_FULL_MAILBOX);
+    }
+};
+
+class relayActions : public StateActions {
+private:
+    GossipPush* gp;
+public:
+    relayActions(GossipPush* gpp):gp(gpp){};
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        gp->relaying();
+    }
+};
+
+class electActions : public StateActions {
+private:
+    GossipPush* gp;
+public:
+    electActions(GossipPush* gpp):gp(gpp){};
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        if (gp->electAggregator())
+            stateMachine->reportMessage(gp->isAggregator() ? MSG_PROMOTED : MSG_DEMOTED);
+    }
+};
+
+class promotedActions : public StateActions {
+private:
+    GossipPush* gp;
+public:
+    promotedActions(GossipPush* gpp):gp(gpp){};
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        gp->promote();
+    }
+};
+
+class demotedActions : public StateActions {
+private:
+    GossipPush* gp;
+public:
+    demotedActions(GossipPush* gpp):gp(gpp){};
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        gp->resign();
     }
 };
 
@@ -377,9 +1942,8 @@ private:
     GossipPush* gp;
 public:
     cActions(GossipPush* gpp):gp(gpp){};
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) {
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
         gp->gossiping();
-        stateMachine->reportMessage(MSG_TRUE);
     }
 };
 
@@ -388,20 +1952,10 @@ private:
     GossipPush* gp;
 public:
     helloActions(GossipPush* gpp):gp(gpp){};
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) {
-        GossipHello* gh = check_and_cast_nullable<GossipHello*>(dynamic_cast<GossipHello*>((cPacket*)extraData));
-
-        if (gh == nullptr) {
-            // panic
-            EV_ERROR << "NOOOOOOOOOOOOO, processing a packet as GossipHello when it is not GossipHello\n";
-            return;
-        }
-
-        gp->addNewAddress(gh->getId());
-
-        delete gh;
-
-        stateMachine->reportMessage(MSG_TRUE);
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        GossipHello* gh = extraData.release<GossipHello>();
+        gp->processHello(gh);
+        gp->recycle(gh);
     }
 };
 
@@ -411,23 +1965,70 @@ private:
     StateMachine* sm_Gossip;
 public:
     dataActions(GossipPush* gpp, StateMachine* t_Gossip):gp(gpp), sm_Gossip(t_Gossip) {};
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) {
-        Gossip* g = check_and_cast_nullable<Gossip*>(dynamic_cast<Gossip*>((cPacket*)extraData));
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        Gossip* g = extraData.release<Gossip>();
+        gp->processMembership(g);
+        bool fresh = gp->addNewInfection(g);
+        if (gp->isPlumtree())
+            gp->plumtreeReceived(g, fresh);
+        gp->recycle(g);
 
-        if ( g == nullptr )  {
-            // panic
-            EV_ERROR << "NOOOOOOOOOOOOO, processing a packet as Gossip when it is not Gossip\n";
-            return;
-        }
-
-        gp->addNewInfection(g);
+        // activate the ticker
+        sm_Gossip->reportMessage(MSG_ACTIVATE);
+    }
+};
 
-        delete g;
+class codedActions : public StateActions {
+private:
+    GossipPush* gp;
+    StateMachine* sm_Gossip;
+public:
+    codedActions(GossipPush* gpp, StateMachine* t_Gossip):gp(gpp), sm_Gossip(t_Gossip) {};
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        gp->addCodedPiece(extraData.get<GossipCoded>());
 
         // activate the ticker
         sm_Gossip->reportMessage(MSG_ACTIVATE);
+    }
+};
+
+class ihaveActions : public StateActions {
+private:
+    GossipPush* gp;
+public:
+    ihaveActions(GossipPush* gpp):gp(gpp){};
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        gp->processIHave(extraData.get<GossipIHave>());
+    }
+};
 
-        stateMachine->reportMessage(MSG_TRUE);
+class graftActions : public StateActions {
+private:
+    GossipPush* gp;
+public:
+    graftActions(GossipPush* gpp):gp(gpp){};
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        gp->processGraft(extraData.get<GossipGraft>());
+    }
+};
+
+class pruneActions : public StateActions {
+private:
+    GossipPush* gp;
+public:
+    pruneActions(GossipPush* gpp):gp(gpp){};
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        gp->processPrune(extraData.get<GossipPrune>());
+    }
+};
+
+class missingActions : public StateActions {
+private:
+    GossipPush* gp;
+public:
+    missingActions(GossipPush* gpp):gp(gpp){};
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        gp->graftMissing(extraData.get<cMessage>());
     }
 };
 
@@ -436,9 +2037,9 @@ StateMachine* GossipPush::createProtocolStateMachine()
 
     StateMachine* sm = new StateMachine(string("protocol_") + myself);
 
-    sm_tick_hello = buildTicker(string("ticker hello"), HELLO_INTERVAL, sm, MSG_GREET, this);
-    sm_tick_gossip = buildTicker(string("ticker gossip"), gossipInterval, sm, MSG_GOSSIP, this);
-    sm_tick_new_gossip = buildTicker(string("ticker new gossip"), intervalAmongNewMessages, sm, MSG_NEW_GOSSIP, this);
+    sm_tick_hello = buildTicker(string("ticker hello"), [this] () { return tickDelay(helloInterval); }, sm, MSG_GREET, this);
+    sm_tick_gossip = buildTicker(string("ticker gossip"), [this] () { return tickDelay(gossipInterval); }, sm, MSG_GOSSIP, this);
+    sm_tick_new_gossip = buildTicker(string("ticker new gossip"), [this] () { return nextArrival(); }, sm, MSG_NEW_GOSSIP, this);
 
     auto s = new State("s", new NoActions()); // done
     auto w = new State("w", new wActions(sm_tick_hello, sm_tick_new_gossip)); // done
@@ -448,6 +2049,15 @@ StateMachine* GossipPush::createProtocolStateMachine()
     auto hello = new State("hello", new helloActions(this)); // done
     auto data = new State("data", new dataActions(this, sm_tick_gossip)); // done
     auto c = new State("c", new cActions(this)); // done
+    auto coded = new State("coded", new codedActions(this, sm_tick_gossip));
+    auto ihave = new State("ihave", new ihaveActions(this));
+    auto graft = new State("graft", new graftActions(this));
+    auto prune = new State("prune", new pruneActions(this));
+    auto miss = new State("missing", new missingActions(this));
+    auto elect = new State("elect", new electActions(this));
+    auto relay = new State("relay", new relayActions(this));
+    auto promoted = new State("promoted", new promotedActions(this));
+    auto demoted = new State("demoted", new demotedActions(this));
 
     sm->addState(s);
     sm->addState(w);
@@ -457,6 +2067,15 @@ StateMachine* GossipPush::createProtocolStateMachine()
     sm->addState(hello);
     sm->addState(data);
     sm->addState(c);
+    sm->addState(coded);
+    sm->addState(ihave);
+    sm->addState(graft);
+    sm->addState(prune);
+    sm->addState(miss);
+    sm->addState(elect);
+    sm->addState(relay);
+    sm->addState(promoted);
+    sm->addState(demoted);
 
     // from s
     sm->addTransition(MSG_INITIALIZE, s, w);
@@ -467,25 +2086,50 @@ StateMachine* GossipPush::createProtocolStateMachine()
     sm->addTransition(MSG_HELLO, w,hello);
     sm->addTransition(MSG_DATA, w,data);
     sm->addTransition(MSG_GOSSIP, w,g);
+    sm->addTransition(MSG_CODED, w,coded);
+    sm->addTransition(MSG_IHAVE, w,ihave);
+    sm->addTransition(MSG_GRAFT, w,graft);
+    sm->addTransition(MSG_PRUNE, w,prune);
+    sm->addTransition(MSG_GRAFT_TIMEOUT, w,miss);
+    sm->addTransition(MSG_PROMOTED, w,promoted);
+    sm->addTransition(MSG_DEMOTED, w,demoted);
 
     // from ng
-    sm->addTransition(MSG_TRUE, ng, w);
+    sm->addCompletionTransition(ng, w);
 
-    // from h
-    sm->addTransition(MSG_TRUE, h, w);
+    // from h, the members just heard from decide who the aggregator is
+    sm->addCompletionTransition(h, elect);
+    sm->addCompletionTransition(elect, w);
 
     // from hello
-    sm->addTransition(MSG_TRUE, hello, w);
+    sm->addCompletionTransition(hello, w);
 
     // from data
-    sm->addTransition(MSG_TRUE, data, w);
+    sm->addCompletionTransition(data, w);
 
     // from g
     sm->addTransition(MSG_EMPTY_MAILBOX, g, w);
     sm->addTransition(MSG_FULL_MAILBOX, g, c);
+    sm->addTransition(MSG_RELAY, g, relay);
+
+    // from relay, the aggregator also gossips inside its cluster
+    sm->addCompletionTransition(relay, c);
 
     // from c
-    sm->addTransition(MSG_TRUE, c, w);
+    sm->addCompletionTransition(c, w);
+
+    // from coded
+    sm->addCompletionTransition(coded, w);
+
+    // from the role changes of the hierarchical mode
+    sm->addCompletionTransition(promoted, w);
+    sm->addCompletionTransition(demoted, w);
+
+    // from the Plumtree states
+    sm->addCompletionTransition(ihave, w);
+    sm->addCompletionTransition(graft, w);
+    sm->addCompletionTransition(prune, w);
+    sm->addCompletionTransition(miss, w);
 
     return sm;
 }
@@ -20,6 +20,8 @@
 
 #include <map>
 #include <vector>
+#include <deque>
+#include <set>
 #include <string>
 
 #include "inet/common/INETDefs.h"
@@ -27,12 +29,24 @@
 #include "inet/applications/base/ApplicationBase.h"
 #include "inet/transportlayer/contract/udp/UDPSocket.h"
 
+#include "GossipPacket_m.h"
 #include "Gossip_m.h"
 #include "GossipHello_m.h"
+#include "GossipIHave_m.h"
+#include "GossipGraft_m.h"
+#include "GossipPrune_m.h"
+#include "GossipCoded_m.h"
 
 #include "TickAutomaton.h"
 #include "StateMachine.h"
 #include "StateMachineInterpreter.h"
+#include "BatchInterpreter.h"
+#include "TokenBucket.h"
+#include "GossipAnalyzer.h"
+#include "EventTrace.h"
+#include "Rlnc.h"
+#include "PacketRecycler.h"
+#include "BloomFilter.h"
 
 namespace inet {
 
@@ -40,8 +54,6 @@ using std::map;
 using std::vector;
 using std::string;
 
-const double HELLO_INTERVAL = 0.6;
-
 /**
  * TODO - Generated class
  */
@@ -53,17 +65,122 @@ class INET_API GossipPush : public ApplicationBase, public ITimeOutProducer
     int localPort = 10000;
 
     bool isSource = false; // indicates whether the app is the source of messages
-    int numMessages = 1; // how many messages to send
+    int numMessages = 1; // how many messages to send, -1 means no limit
     double intervalAmongNewMessages = 5; // how much time to wait between two different new messages created in this node
 
+    // workload
+    enum ArrivalProcess {
+        ARRIVAL_PERIODIC,
+        ARRIVAL_POISSON,
+        ARRIVAL_ONOFF,
+        ARRIVAL_TRACE
+    };
+    ArrivalProcess arrivalProcess = ARRIVAL_PERIODIC;
+    double onDuration = 1;
+    double offDuration = 1;
+    double onPeriodEnd = -1;
+    class TraceEntry {
+    public:
+        double time;
+        int payloadLength;
+    };
+    vector<TraceEntry> trace;
+    unsigned int traceArmed = 0; // next entry the ticker waits for
+    unsigned int traceNext = 0; // next entry to create
+
+    // statistics
+    GossipAnalyzer* analyzer = nullptr;
+    EventTrace* eventTrace = nullptr;
+    static simsignal_t infectionStoreSizeSignal;
+    static simsignal_t pendingSendsSignal;
+
+    // memory accounting, estimated bytes held by each part of the node
+    enum MemoryCategory {
+        MEMORY_INFECTIONS,
+        MEMORY_MEMBERS, // addresses, memberIds, tombstones and the Plumtree peers
+        MEMORY_NEIGHBORS, // possibleNeighbors and the contacted addresses
+        MEMORY_POOL, // messages waiting for the protocol machine and their packets
+        MEMORY_TIMERS, // timers, listeners and missing infections
+        MEMORY_MACHINES, // state machines and interpreters
+        MEMORY_SENDS, // pending sends and recycled packets
+        MEMORY_CATEGORIES
+    };
+    double memorySampleInterval = 0;
+    cMessage* memoryTimer = nullptr;
+    cOutVector memoryVectors[MEMORY_CATEGORIES + 1]; // the last one is the total
+    long memoryPeaks[MEMORY_CATEGORIES + 1] = {};
+
     // gossip stuff
     int nodesPerRound = 1; // this node will gossip with 'nodesPerRound' in each round
     int roundRatio = 2; // the number of rounds is 'roundRatio*numberOfAddresses'
 
     double gossipInterval = 0.1;
+    double helloInterval = 0.6;
+
+    // membership piggybacked on gossip
+    bool piggybackMembership = false;
+    int piggybackPeers = 3;
+
+    // desynchronization of the tickers
+    double startTime = 0.01;
+    double startJitter = 0;
+    double tickJitter = 0;
+    bool exponentialJitter = false;
+
+    // outgoing gossip is paced by a token bucket and sent by priority
+    enum GossipPriority {
+        PRIORITY_FIFO,
+        PRIORITY_NEWEST,
+        PRIORITY_FEWEST_ROUNDS
+    };
+    GossipPriority gossipPriority = PRIORITY_FIFO;
+    TokenBucket sendBudget;
+    int maxPendingSends = 1000;
+    class PendingSend {
+    public:
+        cPacket* pkt; // Gossip or GossipCoded
+        int wireType;
+        int id;
+        L3Address to;
+        double priority; // lower goes first
+    };
+    std::deque<PendingSend> pendingSends;
+    cMessage* sendTimer = nullptr;
+    long numDroppedSends = 0;
+
+    // what we know about a network member
+    class GossipMember {
+    public:
+        L3Address address;
+        int heartbeat; // highest known, also from second hand news
+        int directHeartbeat; // highest heard from the member itself, -1 if none
+        double lastHeard;
+        double meanInterval; // smoothed time between two hellos, used by the phi detector
+        double peerTimestamp; // last hello timestamp, echoed back in our next hello
+        double peerTimestampArrival;
+        double srtt; // smoothed round trip time, -1 if unknown
+        double lastSent; // last gossip carrying our membership sent to it, -1 if none
+        int cluster; // hierarchical mode, -1 if unknown
+        bool aggregator;
+        vector<uint8_t> subscriptions; // their BloomFilter of topics, empty if they take all of them
+    };
+    map<string, GossipMember> addresses; // network members
+    map<L3Address, string> memberIds; // reverse index of 'addresses'
+    map<string, int> tombstones; // last heartbeat of the members we forgot, second hand news about them must be newer
+
+    // peer selection
+    enum PeerSelection {
+        SELECT_ALL,
+        SELECT_RANDOM,
+        SELECT_RTT
+    };
+    PeerSelection peerSelection = SELECT_ALL;
+    double randomLinkFraction = 0.2;
+    vector<L3Address> possibleNeighbors; // everybody for a static bootstrap, only the seeds otherwise, plus the addresses to discover in hierarchical mode
 
-    map<string, L3Address> addresses; // network members
-    vector<L3Address> possibleNeighbors;
+    // bootstrap from a few seeds, the members are learnt from the hello samples
+    bool bootstrapSeeds = false;
+    int helloSampleSize = 3;
 
     // to assign ids to messages
     int lastIdMsg = 1;
@@ -73,14 +190,32 @@ class INET_API GossipPush : public ApplicationBase, public ITimeOutProducer
     public:
         int idMsg;
         string source;
-        string text;
+        int topic;
+        int payloadLength;
         int roundsLeft;
+        double learnt; // when this node created or first received it, for PRIORITY_NEWEST
+        std::shared_ptr<RlncPayload> coded; // pieces of a chunked payload, null if sent whole
     };
     vector<GossipInfection> infections;
 
+    // topics: the payloads of the other topics are only relayed, then just their id is kept
+    std::set<int> subscriptions; // empty means every topic
+    double relayFraction = 0.2;
+    std::set<uint64_t> relayedIds; // see infectionKey()
+    bool isSubscribed(int topic) { return topic == 0 || subscriptions.empty() || subscriptions.count(topic) > 0; }
+    static uint64_t infectionKey(const string& source, int id);
+    void compactInfections();
+
 
     // communication
     UDPSocket socket;
+    bool verifyWire = false; // every packet sent is encoded and decoded to check its wire length
+
+    // outgoing packets are copies of a prototype, made from recycled packets when possible
+    Gossip gossipPrototype;
+    GossipHello helloPrototype;
+    PacketRecycler<Gossip> gossipPackets;
+    PacketRecycler<GossipHello> helloPackets;
 
     // control messages
     cMessage* ctrlMsg0 = nullptr;
@@ -93,11 +228,59 @@ class INET_API GossipPush : public ApplicationBase, public ITimeOutProducer
     StateMachine* sm_tick_gossip;
     StateMachine* sm_tick_new_gossip;
     StateMachine* sm_tick_hello;
-    StateMachine* sm_proptocol;
+    StateMachine* sm_proptocol = nullptr;
     vector<StateMachineInterpreter*> interpreters;
+    BatchInterpreter* tickerBatch = nullptr; // moves our tickers, shared by the nodes of the network
+    vector<int> tickerSlots;
 
     map<cMessage*, ITimeOut*> timers;
 
+    // network coding of large payloads, push mode only
+    bool networkCoding = false;
+    int chunkSize = 1024;
+    int generationSize = 128;
+    long numUselessPieces = 0;
+
+    // Plumtree: payloads are pushed along eager links, the other members only get IHAVE
+    bool plumtree = false;
+    double graftTimeout = 0.2;
+    std::set<L3Address> eagerPeers;
+    std::set<L3Address> lazyPeers;
+    class MissingInfection {
+    public:
+        vector<L3Address> announcers; // who sent IHAVE, in order of arrival
+        cMessage* timer;
+    };
+    map<std::pair<string, int>, MissingInfection> missing;
+
+    // hierarchical mode: members gossip inside their cluster, the aggregators between clusters
+    bool hierarchical = false;
+    int myCluster = -1;
+    bool aggregatorRole = false; // we have the lowest id of the cluster
+    double firstHello = -1; // the election waits for the members to answer it
+    int discoverySample = 8; // discovery hellos per round, and addresses of other clusters kept at start
+    std::set<L3Address> contacted; // got a discovery hello, they answer if we matter to them
+    enum TargetScope {
+        SCOPE_ALL,
+        SCOPE_CLUSTER,
+        SCOPE_AGGREGATORS // of the other clusters
+    };
+    bool inScope(const GossipMember& m, TargetScope scope);
+    void helloTargets(vector<L3Address>& targets);
+    bool gossipRound(TargetScope scope, bool countRound);
+
+    // failure detection
+    int heartbeat = 0;
+    double suspicionTimeout = 0; // 0 means members never expire
+    bool phiDetector = false;
+    double phiThreshold = 8;
+    long numExpiredMembers = 0;
+
+    // warm start
+    string snapshotIn; // directory from where the node state is restored
+    string snapshotOut; // directory where the node state is saved at the end
+    bool warmStarted = false;
+
   protected:
 
     virtual int numInitStages() const override { return NUM_INIT_STAGES; }
@@ -114,20 +297,74 @@ class INET_API GossipPush : public ApplicationBase, public ITimeOutProducer
     virtual void processStart();
 
     void interpreting();
+    void joinTickerBatch();
+    void leaveTickerBatch();
+
+    // interval plus the configured jitter
+    double tickDelay(double interval);
+
+    // time until the next new message according to the arrival process
+    double nextArrival();
+    void loadTrace(const char* fileName);
+
+    void prepareGossip(const GossipInfection& t);
+    GossipCoded* buildCoded(const GossipInfection& t);
+    void queueGossip(const GossipInfection& t, const vector<L3Address>& targets, double priority);
+    void dropPending(PendingSend& p);
+    // sorts what was queued since 'first', merges it with the packets already waiting, trims and starts sending
+    void flushGossip(unsigned int first);
+    void sendPacket(cPacket* pkt, const L3Address& to);
+    void sendPending();
+    void clearPending();
+
+    GossipInfection* findInfection(const string& source, int id);
+    void setEager(const L3Address& peer, bool eager);
+    void plumtreeBroadcast(const GossipInfection& t, const L3Address* except);
+    void clearMissing();
 
     virtual StateMachine* createProtocolStateMachine();
+    void limitPool();
+    void measureMemory(long bytes[MEMORY_CATEGORIES + 1]);
+    void sampleMemory();
+
+    string snapshotFileName(const string& dir);
+    virtual void saveSnapshot(const string& dir);
+    virtual bool loadSnapshot(const string& dir);
 
   public: // and by making this public, I am just signing my death sentence
+    void dumpTrace();
     bool gossiping();
+    bool relaying();
     bool sayHello();
+    void sampleMembers();
+    void sayGoodbye();
+    void expireMembers();
+    void forgetMember(const string& id);
     void newGossip();
-    bool processReceivedGossip(cPacket* pkt);
-    bool processReceivedHello(cPacket* pkt);
+    bool processReceived(GossipPacket* pkt);
     bool isInfected()  { return !infections.empty(); }
-    void addNewAddress(string id);
-    void addNewInfection(Gossip* g);
+    void recycle(Gossip* g) { gossipPackets.recycle(g); }
+    void recycle(GossipHello* gh) { helloPackets.recycle(gh); }
+    void addNewAddress(string id, int heartbeat, const L3Address* address = nullptr, bool secondHand = false);
+    void processHello(GossipHello* gh);
+    void processMembership(Gossip* g);
+    void selectTargets(vector<L3Address>& targets, TargetScope scope, int topic = 0);
+    void pickTargets(vector<GossipMember*>& candidates, int n, vector<L3Address>& targets);
+    bool isAggregator() { return aggregatorRole; }
+    bool electAggregator();
+    void promote();
+    void resign();
+    bool addNewInfection(Gossip* g);
+    bool addCodedPiece(GossipCoded* gc);
+    bool isPlumtree() { return plumtree; }
+    void plumtreeReceived(Gossip* g, bool fresh);
+    void processIHave(GossipIHave* ih);
+    void processGraft(GossipGraft* gg);
+    void processPrune(GossipPrune* gp);
+    void graftMissing(cMessage* timer);
 private:
     static const int TICK_MESSAGE = 456;
+    static const int LEAVING = -1;
 
 
 };
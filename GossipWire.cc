@@ -0,0 +1,329 @@
+/*
+ * GossipWire.cc
+ *
+ *  Binary encoding of the gossip packets as they would travel on the wire.
+ */
+
+#include "GossipWire.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace inet {
+
+static int64_t stringLength(const char* s)
+{
+    uint64_t n = std::strlen(s);
+    return BinaryWriter::varintSize(n) + n;
+}
+
+static int64_t signedVarintSize(int64_t v)
+{
+    return BinaryWriter::varintSize(((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static uint64_t toMicros(double t)
+{
+    return t < 0 ? 0 : (uint64_t)(t * 1e6 + 0.5);
+}
+
+static uint64_t clusterField(const GossipHello* gh)
+{
+    return (uint64_t)(gh->getCluster() + 1) * 2 + (gh->getAggregator() ? 1 : 0);
+}
+
+static int64_t sampleLength(const GossipHello* gh)
+{
+    int64_t n = BinaryWriter::varintSize(gh->getSampleIdsArraySize());
+    for (unsigned int k = 0 ; k < gh->getSampleIdsArraySize() ; k++)
+        n += stringLength(gh->getSampleIds(k)) + stringLength(gh->getSampleAddresses(k)) + signedVarintSize(gh->getSampleHeartbeats(k));
+    return n;
+}
+
+int64_t wireLength(const Gossip* g)
+{
+    int64_t membership = stringLength(g->getSenderId());
+    if (g->getSenderId()[0] != '\0') {
+        membership += signedVarintSize(g->getSenderHeartbeat()) + BinaryWriter::varintSize(g->getRecentPeersArraySize());
+        for (unsigned int k = 0 ; k < g->getRecentPeersArraySize() ; k++)
+            membership += stringLength(g->getRecentPeers(k)) + signedVarintSize(g->getRecentHeartbeats(k));
+    }
+
+    return 1
+            + BinaryWriter::varintSize(g->getId())
+            + stringLength(g->getSource())
+            + BinaryWriter::varintSize(g->getTopic())
+            + membership
+            + BinaryWriter::varintSize(g->getPayloadLength())
+            + g->getPayloadLength();
+}
+
+int64_t wireLength(const GossipHello* gh)
+{
+    return 1 + stringLength(gh->getId()) + signedVarintSize(gh->getHeartbeat())
+            + BinaryWriter::varintSize(toMicros(gh->getTimestamp()))
+            + BinaryWriter::varintSize(toMicros(gh->getEchoTimestamp()) + (gh->getEchoTimestamp() < 0 ? 0 : 1))
+            + BinaryWriter::varintSize(toMicros(gh->getEchoDelay()))
+            + BinaryWriter::varintSize(clusterField(gh))
+            + BinaryWriter::varintSize(gh->getSubscriptionFilterArraySize()) + gh->getSubscriptionFilterArraySize()
+            + sampleLength(gh);
+}
+
+int64_t wireLength(const GossipIHave* ih)
+{
+    return 1 + BinaryWriter::varintSize(ih->getId()) + stringLength(ih->getSource());
+}
+
+int64_t wireLength(const GossipGraft* gg)
+{
+    return 1 + BinaryWriter::varintSize(gg->getId()) + stringLength(gg->getSource());
+}
+
+int64_t wireLength(const GossipPrune* gp)
+{
+    return 1;
+}
+
+int64_t wireLength(const GossipCoded* gc)
+{
+    const CodedPiece& piece = gc->getPiece();
+    return 1
+            + BinaryWriter::varintSize(gc->getId())
+            + stringLength(gc->getSource())
+            + BinaryWriter::varintSize(gc->getTotalLength())
+            + BinaryWriter::varintSize(gc->getChunkSize())
+            + BinaryWriter::varintSize(gc->getGenerationSize())
+            + BinaryWriter::varintSize(gc->getGeneration())
+            + piece.coefficients.size()
+            + gc->getChunkSize();
+}
+
+void encode(const Gossip* g, BinaryWriter& w)
+{
+    w.writeVarint(WIRE_GOSSIP);
+    w.writeVarint(g->getId());
+    w.writeString(g->getSource());
+    w.writeVarint(g->getTopic());
+    w.writeString(g->getSenderId());
+    if (g->getSenderId()[0] != '\0') {
+        w.writeSignedVarint(g->getSenderHeartbeat());
+        w.writeVarint(g->getRecentPeersArraySize());
+        for (unsigned int k = 0 ; k < g->getRecentPeersArraySize() ; k++) {
+            w.writeString(g->getRecentPeers(k));
+            w.writeSignedVarint(g->getRecentHeartbeats(k));
+        }
+    }
+    w.writeVarint(g->getPayloadLength());
+    // the content of the payload is not simulated
+    w.writeZeros(g->getPayloadLength());
+}
+
+void encode(const GossipHello* gh, BinaryWriter& w)
+{
+    w.writeVarint(WIRE_HELLO);
+    w.writeString(gh->getId());
+    w.writeSignedVarint(gh->getHeartbeat());
+    w.writeVarint(toMicros(gh->getTimestamp()));
+    w.writeVarint(gh->getEchoTimestamp() < 0 ? 0 : toMicros(gh->getEchoTimestamp()) + 1);
+    w.writeVarint(toMicros(gh->getEchoDelay()));
+    w.writeVarint(clusterField(gh));
+    w.writeVarint(gh->getSubscriptionFilterArraySize());
+    for (unsigned int k = 0 ; k < gh->getSubscriptionFilterArraySize() ; k++) {
+        uint8_t b = gh->getSubscriptionFilter(k);
+        w.writeBytes(&b, 1);
+    }
+    w.writeVarint(gh->getSampleIdsArraySize());
+    for (unsigned int k = 0 ; k < gh->getSampleIdsArraySize() ; k++) {
+        w.writeString(gh->getSampleIds(k));
+        w.writeString(gh->getSampleAddresses(k));
+        w.writeSignedVarint(gh->getSampleHeartbeats(k));
+    }
+}
+
+void encode(const GossipIHave* ih, BinaryWriter& w)
+{
+    w.writeVarint(WIRE_IHAVE);
+    w.writeVarint(ih->getId());
+    w.writeString(ih->getSource());
+}
+
+void encode(const GossipGraft* gg, BinaryWriter& w)
+{
+    w.writeVarint(WIRE_GRAFT);
+    w.writeVarint(gg->getId());
+    w.writeString(gg->getSource());
+}
+
+void encode(const GossipPrune* gp, BinaryWriter& w)
+{
+    w.writeVarint(WIRE_PRUNE);
+}
+
+void encode(const GossipCoded* gc, BinaryWriter& w)
+{
+    const CodedPiece& piece = gc->getPiece();
+    w.writeVarint(WIRE_CODED);
+    w.writeVarint(gc->getId());
+    w.writeString(gc->getSource());
+    w.writeVarint(gc->getTotalLength());
+    w.writeVarint(gc->getChunkSize());
+    w.writeVarint(gc->getGenerationSize());
+    w.writeVarint(gc->getGeneration());
+    w.writeBytes(piece.coefficients.data(), piece.coefficients.size());
+    w.writeBytes(piece.data->data(), piece.data->size());
+}
+
+bool decode(Gossip* g, BinaryReader& r)
+{
+    if (r.readVarint() != WIRE_GOSSIP) return false;
+    g->setId(r.readVarint());
+    g->setSource(r.readString().c_str());
+    g->setTopic(r.readVarint());
+    g->setSenderId(r.readString().c_str());
+    g->setRecentPeersArraySize(0);
+    g->setRecentHeartbeatsArraySize(0);
+    if (g->getSenderId()[0] != '\0') {
+        g->setSenderHeartbeat(r.readSignedVarint());
+        // the count is not trusted to size the arrays before the entries are read
+        vector<string> peers;
+        vector<int> heartbeats;
+        for (uint64_t n = r.readVarint() ; r.ok() && n > 0 ; n--) {
+            peers.push_back(r.readString());
+            heartbeats.push_back(r.readSignedVarint());
+        }
+        g->setRecentPeersArraySize(peers.size());
+        g->setRecentHeartbeatsArraySize(peers.size());
+        for (unsigned int k = 0 ; k < peers.size() ; k++) {
+            g->setRecentPeers(k, peers[k].c_str());
+            g->setRecentHeartbeats(k, heartbeats[k]);
+        }
+    }
+    g->setPayloadLength(r.readVarint());
+    r.skip(g->getPayloadLength());
+    g->setByteLength(wireLength(g));
+    return r.ok();
+}
+
+bool decode(GossipHello* gh, BinaryReader& r)
+{
+    if (r.readVarint() != WIRE_HELLO) return false;
+    gh->setId(r.readString().c_str());
+    gh->setHeartbeat(r.readSignedVarint());
+    gh->setTimestamp(r.readVarint() / 1e6);
+    uint64_t echo = r.readVarint();
+    gh->setEchoTimestamp(echo == 0 ? -1 : (echo - 1) / 1e6);
+    gh->setEchoDelay(r.readVarint() / 1e6);
+    uint64_t cluster = r.readVarint();
+    gh->setCluster((int)(cluster / 2) - 1);
+    gh->setAggregator(cluster % 2 == 1);
+
+    vector<uint8_t> filter;
+    for (uint64_t n = r.readVarint() ; r.ok() && n > 0 ; n--) {
+        uint8_t b = 0;
+        r.readBytes(&b, 1);
+        filter.push_back(b);
+    }
+    gh->setSubscriptionFilterArraySize(filter.size());
+    for (unsigned int k = 0 ; k < filter.size() ; k++)
+        gh->setSubscriptionFilter(k, filter[k]);
+
+    vector<string> ids, addresses;
+    vector<int> heartbeats;
+    for (uint64_t n = r.readVarint() ; r.ok() && n > 0 ; n--) {
+        ids.push_back(r.readString());
+        addresses.push_back(r.readString());
+        heartbeats.push_back(r.readSignedVarint());
+    }
+    gh->setSampleIdsArraySize(ids.size());
+    gh->setSampleAddressesArraySize(ids.size());
+    gh->setSampleHeartbeatsArraySize(ids.size());
+    for (unsigned int k = 0 ; k < ids.size() ; k++) {
+        gh->setSampleIds(k, ids[k].c_str());
+        gh->setSampleAddresses(k, addresses[k].c_str());
+        gh->setSampleHeartbeats(k, heartbeats[k]);
+    }
+    gh->setByteLength(wireLength(gh));
+    return r.ok();
+}
+
+bool decode(GossipIHave* ih, BinaryReader& r)
+{
+    if (r.readVarint() != WIRE_IHAVE) return false;
+    ih->setId(r.readVarint());
+    ih->setSource(r.readString().c_str());
+    ih->setByteLength(wireLength(ih));
+    return r.ok();
+}
+
+bool decode(GossipGraft* gg, BinaryReader& r)
+{
+    if (r.readVarint() != WIRE_GRAFT) return false;
+    gg->setId(r.readVarint());
+    gg->setSource(r.readString().c_str());
+    gg->setByteLength(wireLength(gg));
+    return r.ok();
+}
+
+bool decode(GossipPrune* gp, BinaryReader& r)
+{
+    if (r.readVarint() != WIRE_PRUNE) return false;
+    gp->setByteLength(wireLength(gp));
+    return r.ok();
+}
+
+bool decode(GossipCoded* gc, BinaryReader& r)
+{
+    if (r.readVarint() != WIRE_CODED) return false;
+    gc->setId(r.readVarint());
+    gc->setSource(r.readString().c_str());
+    gc->setTotalLength(r.readVarint());
+    gc->setChunkSize(r.readVarint());
+    gc->setGenerationSize(r.readVarint());
+    gc->setGeneration(r.readVarint());
+    int length = RlncPayload::generationLength(gc->getTotalLength(), gc->getChunkSize(), gc->getGenerationSize(), gc->getGeneration());
+    // only the first generation of an empty payload has no bytes
+    if (!r.ok() || gc->getChunkSize() <= 0 || gc->getGenerationSize() <= 0 || (length == 0 && (gc->getGeneration() != 0 || gc->getTotalLength() != 0)))
+        return false;
+
+    CodedPiece piece;
+    piece.coefficients.resize(std::max(1, (length + gc->getChunkSize() - 1) / gc->getChunkSize()));
+    r.readBytes(piece.coefficients.data(), piece.coefficients.size());
+    std::shared_ptr< vector<uint8_t> > data = std::make_shared< vector<uint8_t> >(gc->getChunkSize());
+    r.readBytes(data->data(), data->size());
+    piece.data = data;
+    gc->setPiece(piece);
+    gc->setByteLength(wireLength(gc));
+    return r.ok();
+}
+
+template<class T>
+static bool roundTrip(const T* p)
+{
+    std::ostringstream out;
+    BinaryWriter w(out);
+    encode(p, w);
+    string bytes = out.str();
+    if ((int64_t)bytes.size() != wireLength(p))
+        return false;
+
+    std::istringstream in(bytes);
+    BinaryReader r(in);
+    T copy;
+    return decode(&copy, r) && wireLength(&copy) == (int64_t)bytes.size();
+}
+
+bool checkEncoding(const GossipPacket* pkt)
+{
+    switch (pkt->getWireType()) {
+        case WIRE_GOSSIP: return roundTrip(static_cast<const Gossip*>(pkt));
+        case WIRE_HELLO: return roundTrip(static_cast<const GossipHello*>(pkt));
+        case WIRE_IHAVE: return roundTrip(static_cast<const GossipIHave*>(pkt));
+        case WIRE_GRAFT: return roundTrip(static_cast<const GossipGraft*>(pkt));
+        case WIRE_PRUNE: return roundTrip(static_cast<const GossipPrune*>(pkt));
+        case WIRE_CODED: return roundTrip(static_cast<const GossipCoded*>(pkt));
+        default: return false;
+    }
+}
+
+} /* namespace inet */
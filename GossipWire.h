@@ -0,0 +1,78 @@
+/*
+ * GossipWire.h
+ *
+ *  Binary encoding of the gossip packets as they would travel on the wire.
+ *
+ *  Gossip      : type(1) | varint id | varint len, source | varint topic
+ *                | varint len, senderId [ | zig-zag varint senderHeartbeat
+ *                | varint n | n * (varint len, peer | zig-zag varint heartbeat) ]
+ *                | varint payloadLength | payload
+ *
+ *                the bracketed membership part is only there if senderId is not empty
+ *  GossipHello : type(1) | varint len, id | zig-zag varint heartbeat
+ *                | varint timestamp | varint echoTimestamp + 1 | varint echoDelay
+ *                | varint (cluster + 1) * 2 + aggregator | varint n, n bytes of subscriptionFilter
+ *                | varint n | n * (varint len, id | varint len, address | zig-zag varint heartbeat)
+ *
+ *  Times are carried in microseconds, an echoTimestamp of 0 on the wire means none.
+ *
+ *  GossipIHave : type(1) | varint id | varint len, source
+ *  GossipGraft : type(1) | varint id | varint len, source
+ *  GossipPrune : type(1)
+ *  GossipCoded : type(1) | varint id | varint len, source | varint totalLength | varint chunkSize
+ *                | varint generationSize | varint generation
+ *                | k coefficients | chunkSize bytes, with k the chunks of that generation
+ *                (generationSize, except in the last one)
+ *
+ *  The simulation does not serialize packets, but their byte length is
+ *  computed from this encoding so the network sees the real cost.
+ *  checkEncoding() keeps both in step, GossipPush runs it on every packet
+ *  it sends when verifyWire is set.
+ */
+
+#ifndef GOSSIPWIRE_H_
+#define GOSSIPWIRE_H_
+
+#include <cstdint>
+
+#include "BinaryStream.h"
+#include "Gossip_m.h"
+#include "GossipHello_m.h"
+#include "GossipIHave_m.h"
+#include "GossipGraft_m.h"
+#include "GossipPrune_m.h"
+#include "GossipCoded_m.h"
+
+namespace inet {
+
+// the wire types (GossipWireTypes) are declared in GossipPacket.msg
+
+int64_t wireLength(const Gossip* g);
+int64_t wireLength(const GossipHello* gh);
+int64_t wireLength(const GossipIHave* ih);
+int64_t wireLength(const GossipGraft* gg);
+int64_t wireLength(const GossipPrune* gp);
+int64_t wireLength(const GossipCoded* gc);
+
+void encode(const Gossip* g, BinaryWriter& w);
+void encode(const GossipHello* gh, BinaryWriter& w);
+void encode(const GossipIHave* ih, BinaryWriter& w);
+void encode(const GossipGraft* gg, BinaryWriter& w);
+void encode(const GossipPrune* gp, BinaryWriter& w);
+void encode(const GossipCoded* gc, BinaryWriter& w);
+
+// decoding returns false if the stream does not contain a packet of that type
+bool decode(Gossip* g, BinaryReader& r);
+bool decode(GossipHello* gh, BinaryReader& r);
+bool decode(GossipIHave* ih, BinaryReader& r);
+bool decode(GossipGraft* gg, BinaryReader& r);
+bool decode(GossipPrune* gp, BinaryReader& r);
+bool decode(GossipCoded* gc, BinaryReader& r);
+
+// encodes the packet and decodes it back, false if the encoding is not wireLength() bytes long
+// or does not decode to a packet of the same length
+bool checkEncoding(const GossipPacket* pkt);
+
+} /* namespace inet */
+
+#endif /* GOSSIPWIRE_H_ */
@@ -0,0 +1,58 @@
+/*
+ * PacketRecycler.h
+ *
+ *  Keeps packets that were received and processed so they can be reused
+ *  for outgoing packets instead of allocating new ones.
+ */
+
+#ifndef PACKETRECYCLER_H_
+#define PACKETRECYCLER_H_
+
+#include <vector>
+
+namespace inet {
+
+/**
+ * T is a packet class generated from a .msg file. Packets given back must be
+ * owned by the module using the recycler, which is the case for any packet
+ * it received.
+ */
+template<class T>
+class PacketRecycler {
+protected:
+    std::vector<T*> packets;
+    unsigned int capacity = 0;
+public:
+    void setCapacity(unsigned int c) { capacity = c; }
+
+    // a packet with the same content as 'prototype'
+    T* copyOf(const T& prototype) {
+        if (packets.empty())
+            return prototype.dup();
+        T* p = packets.back();
+        packets.pop_back();
+        *p = prototype;
+        return p;
+    }
+
+    void recycle(T* p) {
+        delete p->removeControlInfo();
+        if (packets.size() < capacity)
+            packets.push_back(p);
+        else
+            delete p;
+    }
+
+    // must be called before the owner module goes away
+    void clear() {
+        for (T* p : packets)
+            delete p;
+        packets.clear();
+    }
+
+    unsigned int size() { return packets.size(); }
+};
+
+} /* namespace inet */
+
+#endif /* PACKETRECYCLER_H_ */
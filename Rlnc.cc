@@ -0,0 +1,172 @@
+/*
+ * Rlnc.cc
+ *
+ *  Random linear network coding over GF(2^8).
+ */
+
+#include "Rlnc.h"
+#include "Gf256.h"
+
+#include <algorithm>
+
+namespace inet {
+
+RlncGeneration::RlncGeneration(int totalLength, int chunkSize):chunkSize(chunkSize), totalLength(totalLength)
+{
+    k = chunkSize <= 0 ? 1 : std::max(1, (totalLength + chunkSize - 1) / chunkSize);
+}
+
+RlncGeneration RlncGeneration::fromPayload(const vector<uint8_t>& payload, int chunkSize)
+{
+    RlncGeneration g(payload.size(), chunkSize);
+    for (int i = 0 ; i < g.k ; i++) {
+        vector<uint8_t> row(g.k + chunkSize, 0);
+        row[i] = 1;
+        size_t from = std::min((size_t)i * chunkSize, payload.size());
+        size_t n = std::min((size_t)chunkSize, payload.size() - from);
+        std::copy(payload.begin() + from, payload.begin() + from + n, row.begin() + g.k);
+        g.rows.push_back(row);
+        g.pivots.push_back(i);
+    }
+    return g;
+}
+
+bool RlncGeneration::add(const CodedPiece& piece)
+{
+    if (isComplete() || (int)piece.coefficients.size() != k || piece.data == nullptr || (int)piece.data->size() != chunkSize)
+        return false;
+
+    vector<uint8_t> row(k + chunkSize);
+    std::copy(piece.coefficients.begin(), piece.coefficients.end(), row.begin());
+    std::copy(piece.data->begin(), piece.data->end(), row.begin() + k);
+
+    // remove what the rows already explain
+    for (unsigned int r = 0 ; r < rows.size() ; r++) {
+        uint8_t c = row[pivots[r]];
+        if (c != 0)
+            gf256MulAddRegion(row.data(), rows[r].data(), c, row.size());
+    }
+
+    int pivot = 0;
+    while (pivot < k && row[pivot] == 0)
+        pivot++;
+    if (pivot == k)
+        return false;
+
+    gf256MulRegion(row.data(), gf256Inv(row[pivot]), row.size());
+
+    // keep the form reduced so a complete generation is the identity
+    for (unsigned int r = 0 ; r < rows.size() ; r++) {
+        uint8_t c = rows[r][pivot];
+        if (c != 0)
+            gf256MulAddRegion(rows[r].data(), row.data(), c, row.size());
+    }
+
+    rows.push_back(row);
+    pivots.push_back(pivot);
+    return true;
+}
+
+CodedPiece RlncGeneration::recode(const vector<uint8_t>& mix) const
+{
+    vector<uint8_t> row(k + chunkSize, 0);
+    for (unsigned int r = 0 ; r < rows.size() && r < mix.size() ; r++)
+        gf256MulAddRegion(row.data(), rows[r].data(), mix[r], row.size());
+
+    CodedPiece piece;
+    piece.coefficients.assign(row.begin(), row.begin() + k);
+    piece.data = std::make_shared< const vector<uint8_t> >(row.begin() + k, row.end());
+    return piece;
+}
+
+CodedPiece RlncGeneration::row(int r) const
+{
+    CodedPiece piece;
+    piece.coefficients.assign(rows[r].begin(), rows[r].begin() + k);
+    piece.data = std::make_shared< const vector<uint8_t> >(rows[r].begin() + k, rows[r].end());
+    return piece;
+}
+
+vector<uint8_t> RlncGeneration::decode() const
+{
+    vector<uint8_t> payload((size_t)k * chunkSize);
+    for (unsigned int r = 0 ; r < rows.size() ; r++)
+        std::copy(rows[r].begin() + k, rows[r].end(), payload.begin() + (size_t)pivots[r] * chunkSize);
+    payload.resize(totalLength);
+    return payload;
+}
+
+RlncPayload::RlncPayload(int totalLength, int chunkSize, int generationSize)
+    :totalLength(totalLength), chunkSize(chunkSize), generationSize(generationSize)
+{
+    int g = 0;
+    do {
+        generations.push_back(RlncGeneration(generationLength(totalLength, chunkSize, generationSize, g), chunkSize));
+        g++;
+    } while (generationLength(totalLength, chunkSize, generationSize, g) > 0);
+}
+
+RlncPayload* RlncPayload::fromPayload(const vector<uint8_t>& payload, int chunkSize, int generationSize)
+{
+    RlncPayload* p = new RlncPayload(payload.size(), chunkSize, generationSize);
+    size_t from = 0;
+    for (RlncGeneration& g : p->generations) {
+        vector<uint8_t> part(payload.begin() + from, payload.begin() + from + g.getTotalLength());
+        g = RlncGeneration::fromPayload(part, chunkSize);
+        from += part.size();
+    }
+    return p;
+}
+
+int RlncPayload::generationLength(int totalLength, int chunkSize, int generationSize, int g)
+{
+    if (chunkSize <= 0 || generationSize <= 0 || g < 0)
+        return 0;
+    int64_t span = (int64_t)chunkSize * generationSize;
+    int64_t from = span * g;
+    if (from >= totalLength)
+        return 0;
+    return (int)std::min(span, (int64_t)totalLength - from);
+}
+
+int RlncPayload::getK() const
+{
+    int k = 0;
+    for (const RlncGeneration& g : generations)
+        k += g.getK();
+    return k;
+}
+
+int RlncPayload::getRank() const
+{
+    int rank = 0;
+    for (const RlncGeneration& g : generations)
+        rank += g.getRank();
+    return rank;
+}
+
+bool RlncPayload::isComplete() const
+{
+    return std::all_of(generations.begin(), generations.end(), [] (const RlncGeneration& g) { return g.isComplete(); });
+}
+
+vector<uint8_t> RlncPayload::decode() const
+{
+    vector<uint8_t> payload;
+    payload.reserve(totalLength);
+    for (const RlncGeneration& g : generations) {
+        vector<uint8_t> part = g.decode();
+        payload.insert(payload.end(), part.begin(), part.end());
+    }
+    return payload;
+}
+
+size_t RlncPayload::footprint() const
+{
+    size_t bytes = generations.capacity() * sizeof(RlncGeneration);
+    for (const RlncGeneration& g : generations)
+        bytes += g.footprint();
+    return bytes;
+}
+
+} /* namespace inet */
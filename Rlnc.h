@@ -0,0 +1,111 @@
+/*
+ * Rlnc.h
+ *
+ *  Random linear network coding over GF(2^8). A payload is split in chunks,
+ *  grouped in generations of at most generationSize chunks. Pieces are random
+ *  combinations of the k chunks of one generation and any k independent
+ *  pieces give that generation back.
+ */
+
+#ifndef RLNC_H_
+#define RLNC_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace inet {
+
+using std::vector;
+
+/**
+ * One coded piece: the coefficients applied to each of the k chunks and the
+ * resulting data. The data is shared so copies of a packet do not copy it.
+ */
+class CodedPiece {
+public:
+    vector<uint8_t> coefficients;
+    std::shared_ptr< const vector<uint8_t> > data;
+};
+
+/**
+ * What a node knows about a payload: the pieces received so far, kept in
+ * reduced row echelon form. The source starts with the k chunks themselves.
+ */
+class RlncGeneration {
+protected:
+    int k;
+    int chunkSize;
+    int totalLength;
+    // each row is k coefficients followed by chunkSize bytes
+    vector< vector<uint8_t> > rows;
+    vector<int> pivots; // column of the leading 1 of each row
+public:
+    RlncGeneration(int totalLength, int chunkSize);
+
+    // a generation holding the whole of 'payload'
+    static RlncGeneration fromPayload(const vector<uint8_t>& payload, int chunkSize);
+
+    int getK() const { return k; }
+    int getChunkSize() const { return chunkSize; }
+    int getTotalLength() const { return totalLength; }
+    int getRank() const { return rows.size(); }
+    bool isComplete() const { return getRank() == k; }
+
+    // returns true if the piece was innovative, i.e. the rank grew
+    bool add(const CodedPiece& piece);
+
+    // combination of the rows held, 'mix' has one coefficient per row
+    CodedPiece recode(const vector<uint8_t>& mix) const;
+
+    // row 'r' as a piece, adding the rows to an empty generation gives this one back
+    CodedPiece row(int r) const;
+
+    // only valid once complete
+    vector<uint8_t> decode() const;
+
+    // bytes held by the rows
+    size_t footprint() const { return rows.size() * (k + chunkSize); }
+};
+
+/**
+ * A payload coded as independent generations, so the coefficients carried by
+ * each piece and the cost of decoding are bounded by the generation size
+ * instead of growing with the payload.
+ */
+class RlncPayload {
+protected:
+    int totalLength;
+    int chunkSize;
+    int generationSize; // chunks per generation, the last one may have fewer
+    vector<RlncGeneration> generations;
+public:
+    RlncPayload(int totalLength, int chunkSize, int generationSize);
+
+    // the source holds every chunk
+    static RlncPayload* fromPayload(const vector<uint8_t>& payload, int chunkSize, int generationSize);
+
+    // bytes of the payload in generation 'g', 0 if there is no such generation
+    static int generationLength(int totalLength, int chunkSize, int generationSize, int g);
+
+    int getTotalLength() const { return totalLength; }
+    int getChunkSize() const { return chunkSize; }
+    int getGenerationSize() const { return generationSize; }
+    int getGenerations() const { return generations.size(); }
+    RlncGeneration& getGeneration(int g) { return generations[g]; }
+    const RlncGeneration& getGeneration(int g) const { return generations[g]; }
+
+    // summed over the generations
+    int getK() const;
+    int getRank() const;
+    bool isComplete() const;
+
+    // only valid once complete
+    vector<uint8_t> decode() const;
+
+    size_t footprint() const;
+};
+
+} /* namespace inet */
+
+#endif /* RLNC_H_ */
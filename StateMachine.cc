@@ -6,9 +6,11 @@
  */
 
 #include "StateMachine.h"
+#include "BatchInterpreter.h"
 
 #include <algorithm>
 #include <iterator>     // std::distance
+#include <utility>
 
 #include <iostream>
 
@@ -27,6 +29,7 @@ bool StateMachine::addState(State* s)
 {
     if (s->owner) return false;
     s->owner = this;
+    s->index = states.size();
     this->states.push_back(s);
     return true;
 }
@@ -45,6 +48,18 @@ bool StateMachine::addTransition(MessageType id, State* from, State* to)
     return true;
 }
 
+bool StateMachine::addCompletionTransition(State* from, State* to)
+{
+    vector<State*>::iterator it0 = std::find(states.begin(), states.end(), from);
+    vector<State*>::iterator it1 = std::find(states.begin(), states.end(), to);
+
+    if (it0 == states.end()) return false;
+    if (it1 == states.end()) return false;
+
+    from->setCompletion(std::distance(states.begin(), it1));
+    return true;
+}
+
 void StateMachine::setInitialState(State* s)
 {
     vector<State*>::iterator it0 = std::find(states.begin(), states.end(), s);
@@ -58,6 +73,21 @@ State* StateMachine::getState(int idx)
     return states[idx];
 }
 
+int StateMachine::getStateIndex(State* s)
+{
+    vector<State*>::iterator it = std::find(states.begin(), states.end(), s);
+    if (it == states.end()) return -1;
+    return std::distance(states.begin(), it);
+}
+
+size_t StateMachine::footprint()
+{
+    size_t bytes = sizeof(StateMachine) + states.capacity() * sizeof(State*) + name.capacity();
+    for (State* s : states)
+        bytes += s->footprint();
+    return bytes + pool->footprint();
+}
+
 MessagePool* StateMachine::getPool()
 {
     return pool;
@@ -65,7 +95,10 @@ MessagePool* StateMachine::getPool()
 
 void StateMachine::reportMessage(MessageType msgId)
 {
-    pool->add(msgId);
+    if (batch)
+        batch->post(batchSlot, msgId);
+    else
+        pool->add(msgId);
 }
 
 
@@ -74,6 +107,8 @@ State::State(const State& other)
     this->name = other.name;
     this->owner = other.owner;
     this->actions = other.actions;
+    this->completion = other.completion;
+    this->index = other.index;
     for (Transition* t : other.transitions)
         transitions.push_back(t);
 }
@@ -104,6 +139,20 @@ State* State::next(MessageType id)
     throw runtime_error("There is not a transition with such an ID");
 }
 
+State* State::completionTarget()
+{
+    if (completion < 0)
+        throw runtime_error("There is not a completion transition");
+    return this->owner->getState(completion);
+}
+
+size_t State::footprint()
+{
+    // the actions are not counted, they belong to the code using the machine
+    return sizeof(State) + name.capacity() + transitions.capacity() * sizeof(Transition*)
+            + transitions.size() * sizeof(Transition);
+}
+
 bool State::operator==(const State& other)
 {
     return this->name == other.name && this->owner == other.owner;
@@ -111,37 +160,72 @@ bool State::operator==(const State& other)
 
 MessageType MessagePool::drop(int idx)
 {
-    auto it = messages.begin();
-    std::advance(it, idx);
-    MessageType m = *it;
-    messages.erase(it);
-    auto it2 = extraData.find(idx);
-    if (it2 != extraData.end()) {
-        extraData.erase(it2);
-    }
+    MessageType m = messages[idx];
+    auto limit = limits.find(m);
+    if (limit != limits.end())
+        limit->second.count--;
+    messages.erase(messages.begin() + idx);
+    extraData.erase(extraData.begin() + idx);
     return m;
 }
 
-void* MessagePool::getExtraData(MessageType m)
+Envelope MessagePool::take(int idx)
 {
-    auto it = std::find(messages.begin(), messages.end(), m);
-    if (it == messages.end()) return nullptr;
+    Envelope e = std::move(extraData[idx]);
+    drop(idx);
+    return e;
+}
 
-    int idx = std::distance(messages.begin(), it);
+bool MessagePool::add(MessageType msg, Envelope&& extraData)
+{
+    auto it = limits.find(msg);
+    if (it != limits.end() && it->second.count >= it->second.capacity) {
+        Limit& limit = it->second;
+        limit.shed++;
+        if (limit.policy == DROP_NEWEST || limit.capacity <= 0)
+            return false;
+
+        if (limit.policy == COALESCE && limit.equivalent) {
+            for (unsigned int i = 0 ; i < messages.size() ; i++) {
+                if (messages[i] == msg && limit.equivalent(this->extraData[i], extraData)) {
+                    // the new one keeps the place of the old one
+                    this->extraData[i] = std::move(extraData);
+                    return true;
+                }
+            }
+        }
+
+        auto oldest = std::find(messages.begin(), messages.end(), msg);
+        drop(std::distance(messages.begin(), oldest));
+    }
 
-    auto i2 = extraData.find(idx);
+    if (it != limits.end())
+        it->second.count++;
+    messages.push_back(msg);
+    this->extraData.push_back(std::move(extraData));
+    return true;
+}
 
-    if (i2 != extraData.end()) {
-        return i2->second;
-    }
-    return nullptr;
+void MessagePool::setLimit(MessageType msg, int capacity, OverloadPolicy policy, Equivalence equivalent)
+{
+    Limit& limit = limits[msg];
+    limit.capacity = capacity;
+    limit.policy = policy;
+    limit.equivalent = equivalent;
+    limit.count = std::count(messages.begin(), messages.end(), msg);
 }
 
-void MessagePool::add(MessageType msg, void* extraData)
+size_t MessagePool::footprint()
 {
-    int t = messages.size();
-    messages.push_back(msg);
-    this->extraData.insert( std::pair<int, void*>(t, extraData) );
+    // a map node is about four pointers on top of its value
+    return sizeof(MessagePool) + messages.capacity() * sizeof(MessageType) + extraData.capacity() * sizeof(Envelope)
+            + limits.size() * (sizeof(std::pair<const MessageType, Limit>) + 4 * sizeof(void*));
+}
+
+long MessagePool::getShed(MessageType msg)
+{
+    auto it = limits.find(msg);
+    return it == limits.end() ? 0 : it->second.shed;
 }
 
 Transition::~Transition()
@@ -13,6 +13,9 @@
 #include <stdexcept>
 #include <iostream>
 #include <map>
+#include <functional>
+
+#include "Envelope.h"
 
 using std::vector;
 using std::map;
@@ -32,6 +35,7 @@ enum BasicTypes {
 class StateMachine;
 class State;
 class MessagePool;
+class BatchInterpreter;
 
 /**
  * A state Machine, isn't it obvious? :-P
@@ -42,6 +46,8 @@ protected:
     int initialState = 0;
     MessagePool* pool;
     string name;
+    BatchInterpreter* batch = nullptr; // runs the machine instead of a StateMachineInterpreter
+    int batchSlot = -1;
 public:
     StateMachine(string n);
     virtual ~StateMachine();
@@ -50,16 +56,34 @@ public:
 
     bool addTransition(MessageType id, State* from, State* to);
 
+    /**
+     * A completion transition is taken as soon as the actions of 'from' are done,
+     * without going through the pool (no need for reportMessage(MSG_TRUE))
+     */
+    bool addCompletionTransition(State* from, State* to);
+
     State* getInitialState() { return states[initialState]; }
     void setInitialState(State* s);
 
     State* getState(int idx);
 
+    // -1 if the state does not belong to this machine
+    int getStateIndex(State* s);
+
+    int countStates() { return states.size(); }
+
     virtual void reportMessage(MessageType msgId);
 
+    void setBatch(BatchInterpreter* b, int slot) { batch = b; batchSlot = slot; }
+    BatchInterpreter* getBatch() { return batch; }
+    int getBatchSlot() { return batchSlot; }
+
     MessagePool* getPool();
 
     string getName() { return name; }
+
+    // bytes held by the machine, its states and its pool, without the payloads in the pool
+    size_t footprint();
 };
 
 /**
@@ -80,12 +104,12 @@ public:
 
 class StateActions {
 public:
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) = 0;
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) = 0;
 };
 
 class NoActions : public StateActions {
 public:
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) {}
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {}
 };
 
 class LogActions : public StateActions {
@@ -94,7 +118,7 @@ private:
 public:
     LogActions(std::string a): msg(a) {}
 
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) {
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
         std::cout << " LALLAAL  " << this->msg << std::endl;
     }
 };
@@ -106,6 +130,8 @@ class State {
 protected:
     string name;
     vector<Transition*> transitions;
+    int completion = -1;
+    int index = -1; // position in the owner
     StateMachine* owner = nullptr;
     StateActions* actions = nullptr;
 public:
@@ -117,33 +143,81 @@ public:
 
     bool existsTransition(MessageType id);
 
+    const vector<Transition*>& getTransitions() { return transitions; }
+
     State* next(MessageType id);
 
+    void setCompletion(int to) { completion = to; }
+
+    bool hasCompletion() { return completion >= 0; }
+
+    State* completionTarget();
+
     string getName() {  return name; }
 
+    int getIndex() { return index; }
+
     StateActions* getActions()  { return actions; }
 
     bool operator==(const State& other);
 
+    size_t footprint();
+
     friend bool StateMachine::addState(State* s);
 };
 
+/**
+ * What a full MessagePool does with one more message of a limited type
+ */
+enum OverloadPolicy {
+    DROP_NEWEST, // the new message is discarded
+    DROP_OLDEST, // the oldest message of that type makes room
+    COALESCE // the new message replaces an equivalent one, or the oldest if there is none
+};
+
 /**
  * A pool of messages, notice that is not a queue
  * FIXME: I should be sent to jail for this implementation
  */
 class MessagePool {
+public:
+    // tells if two envelopes of the same message type carry equivalent things
+    typedef std::function<bool(const Envelope&, const Envelope&)> Equivalence;
 protected:
+    class Limit {
+    public:
+        int capacity;
+        OverloadPolicy policy;
+        Equivalence equivalent;
+        int count = 0;
+        long shed = 0;
+    };
+
     vector<MessageType> messages;
-    map<int, void*> extraData;
+    vector<Envelope> extraData; // extraData[i] goes with messages[i]
+    map<MessageType, Limit> limits;
 public:
-    void add(MessageType msg) { messages.push_back(msg); }
-    void add(MessageType msg, void* extraData);
+    /**
+     * At most 'capacity' messages of type 'msg' are kept, the policy decides
+     * which one goes when there is no room. 'equivalent' is only used to coalesce
+     */
+    void setLimit(MessageType msg, int capacity, OverloadPolicy policy, Equivalence equivalent = nullptr);
+    // messages of that type discarded or replaced for lack of room
+    long getShed(MessageType msg);
+
+    bool add(MessageType msg) { return add(msg, Envelope()); }
+    // false if the pool was full and the new message was discarded
+    bool add(MessageType msg, Envelope&& extraData);
     bool isEmpty() {  return messages.size() == 0;  }
     int count() { return messages.size(); }
     MessageType operator[] (int idx) { return messages[idx]; }
-    void* getExtraData(MessageType m);
+    const Envelope& getExtraData(int idx) { return extraData[idx]; }
     MessageType drop(int idx);
+    // removes the message and hands over what goes with it
+    Envelope take(int idx);
+
+    // bytes held by the pool itself, the payloads are not included
+    size_t footprint();
 };
 
 } /* namespace inet */
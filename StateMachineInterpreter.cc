@@ -6,6 +6,7 @@
  */
 
 #include "StateMachineInterpreter.h"
+#include "BatchInterpreter.h"
 
 #include <iostream>
 
@@ -15,8 +16,31 @@ StateMachineInterpreter::~StateMachineInterpreter() {
     // TODO Auto-generated destructor stub
 }
 
+State* StateMachineInterpreter::getCurrent()
+{
+    return sm->getBatch() ? sm->getBatch()->getCurrent(sm->getBatchSlot()) : current;
+}
+
+void StateMachineInterpreter::setCurrent(State* s)
+{
+    if (sm->getBatch())
+        sm->getBatch()->setCurrent(sm->getBatchSlot(), s);
+    else
+        current = s;
+}
+
+void StateMachineInterpreter::setTrace(EventTrace* t, uint8_t id)
+{
+    trace = t;
+    traceId = id;
+    if (sm->getBatch())
+        sm->getBatch()->setTrace(sm->getBatchSlot(), t, id);
+}
+
 bool StateMachineInterpreter::move()
 {
+    if (sm->getBatch()) return false;
+
     MessagePool* p = sm->getPool();
     bool f;
 //    std::cout << "Pool " << sm->getName() <<  " contains : " << p->count() << " elements " << std::endl;
@@ -37,13 +61,27 @@ bool StateMachineInterpreter::move()
             MessageType m = (*p)[i];
 //            std::cout << " going next " << std::endl;
             current = current->next(m);
+            if (trace)
+                trace->record(TRACE_TRANSITION, traceId, current->getIndex(), m, 0);
 //            std::cout << " Now it is Ok : " << current->getName() << std::endl;
-            current->getActions()->enteringState(current, sm, m, p->getExtraData(m));
-            p->drop(i);
+            Envelope e = p->take(i);
+            current->getActions()->enteringState(current, sm, m, e);
+            complete();
         }
     } while (f);
 
     return c > 0;
 }
 
+void StateMachineInterpreter::complete()
+{
+    while (current->hasCompletion()) {
+        current = current->completionTarget();
+        if (trace)
+            trace->record(TRACE_TRANSITION, traceId, current->getIndex(), MSG_TRUE, 0);
+        Envelope none;
+        current->getActions()->enteringState(current, sm, MSG_TRUE, none);
+    }
+}
+
 } /* namespace inet */
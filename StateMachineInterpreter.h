@@ -9,6 +9,7 @@
 #define STATEMACHINEINTERPRETER_H_
 
 #include "StateMachine.h"
+#include "EventTrace.h"
 
 namespace inet {
 
@@ -16,11 +17,26 @@ class StateMachineInterpreter {
 protected:
     StateMachine* sm;
     State* current;
+    EventTrace* trace = nullptr;
+    uint8_t traceId = TRACE_NO_MACHINE;
+
+    // follows completion transitions until reaching a state that waits for messages
+    void complete();
 public:
     StateMachineInterpreter(StateMachine* sm):sm(sm), current(sm->getInitialState()) {}
     virtual ~StateMachineInterpreter();
 
+    // a machine in a BatchInterpreter is moved by the batch, not here
     bool move();
+
+    StateMachine* getStateMachine() { return sm; }
+    State* getCurrent();
+
+    // every transition is recorded as coming from machine 'id'
+    void setTrace(EventTrace* t, uint8_t id);
+
+    // used to warm start from a snapshot, no actions are executed
+    void setCurrent(State* s);
 };
 
 } /* namespace inet */
@@ -15,9 +15,8 @@ protected:
     MessageType msgId;
 public:
     NotifyTick(StateMachine* t, MessageType mi):target(t), msgId(mi) {}
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) {
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
         target->reportMessage(msgId);
-        stateMachine->reportMessage(MSG_TRUE);
     }
 };
 
@@ -25,18 +24,18 @@ class ActivateTick: public StateActions, public ITimeOut {
 protected:
     StateMachine* sm;
     ITimeOutProducer* top;
-    double d;
+    std::function<double()> delay;
 public:
 
-    ActivateTick(double d, ITimeOutProducer* top) {
+    ActivateTick(StateMachine* sm, std::function<double()> delay, ITimeOutProducer* top) {
+        this->sm = sm;
         this->top= top;
-        this->d = d;
+        this->delay = delay;
     }
 
 
-    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, void* extraData) {
-        sm = stateMachine;
-        top->registerListener(this, d);
+    virtual void enteringState(State* s, StateMachine* stateMachine, MessageType msg, Envelope& extraData) {
+        top->registerListener(this, delay());
     }
 
     virtual void timeOut() {
@@ -46,6 +45,11 @@ public:
 
 
 StateMachine* buildTicker(string name, double d, StateMachine* target, MessageType msgId, ITimeOutProducer* top)
+{
+    return buildTicker(name, [d] () { return d; }, target, msgId, top);
+}
+
+StateMachine* buildTicker(string name, std::function<double()> delay, StateMachine* target, MessageType msgId, ITimeOutProducer* top)
 {
     StateMachine* sm = new StateMachine(name);
 
@@ -55,7 +59,7 @@ StateMachine* buildTicker(string name, double d, StateMachine* target, MessageTy
     sm->addState(s0);
 
     // adding middle state
-    a = new ActivateTick(d, top);
+    a = new ActivateTick(sm, delay, top);
     State* s1 = new State(string("middle"), a);
     sm->addState(s1);
 
@@ -65,11 +69,13 @@ StateMachine* buildTicker(string name, double d, StateMachine* target, MessageTy
     sm->addState(s2);
 
     // adding transitions
-    sm->addTransition(MSG_TRUE, s2, s1);
+    sm->addCompletionTransition(s2, s1);
     sm->addTransition(MSG_FALSE, s1, s2);
     sm->addTransition(MSG_TIME_OUT, s1, s2);
     sm->addTransition(MSG_ACTIVATE, s0, s1);
     //sm->addTransition(MSG_ACTIVATE, s1, s1);
+    // only 'initial' takes an activation, one waiting is enough, the others would pile up while ticking
+    sm->getPool()->setLimit(MSG_ACTIVATE, 1, DROP_NEWEST);
 
     return sm;
 }
@@ -12,6 +12,7 @@
 
 #include <string>
 #include <vector>
+#include <functional>
 
 namespace inet {
 
@@ -41,10 +42,15 @@ protected:
     vector< Record > listeners;
 public:
     virtual void registerListener(ITimeOut* listener, double afterElapsedTime);
+
+    size_t listenersFootprint() const { return listeners.capacity() * sizeof(Record); }
 };
 
 StateMachine* buildTicker(string name, double d, StateMachine* target, MessageType msgId, ITimeOutProducer* top);
 
+// the delay function is called every time the ticker is armed, e.g. to add jitter
+StateMachine* buildTicker(string name, std::function<double()> delay, StateMachine* target, MessageType msgId, ITimeOutProducer* top);
+
 StateMachine* buildDummyAutomaton(MessageType msgId);
 
 }
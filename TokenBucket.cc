@@ -0,0 +1,41 @@
+/*
+ * TokenBucket.cc
+ *
+ *  Byte budget used to pace outgoing packets
+ */
+
+#include "TokenBucket.h"
+
+#include <algorithm>
+
+namespace inet {
+
+void TokenBucket::refill(double now)
+{
+    if (now > lastUpdate) {
+        tokens = std::min(capacity, tokens + (now - lastUpdate) * rate);
+        lastUpdate = now;
+    }
+}
+
+bool TokenBucket::consume(double bytes, double now)
+{
+    if (isUnlimited()) return true;
+    refill(now);
+    // a packet bigger than the bucket goes out once the bucket is full
+    double needed = std::min(bytes, capacity);
+    if (tokens < needed) return false;
+    tokens -= bytes;
+    return true;
+}
+
+double TokenBucket::timeUntil(double bytes, double now)
+{
+    if (isUnlimited()) return 0;
+    refill(now);
+    double needed = std::min(bytes, capacity);
+    if (tokens >= needed) return 0;
+    return (needed - tokens) / rate;
+}
+
+} /* namespace inet */
@@ -0,0 +1,39 @@
+/*
+ * TokenBucket.h
+ *
+ *  Byte budget used to pace outgoing packets
+ */
+
+#ifndef TOKENBUCKET_H_
+#define TOKENBUCKET_H_
+
+namespace inet {
+
+/**
+ * Tokens are bytes, they are refilled at 'rate' bytes per second up to 'capacity'.
+ * A rate of 0 means there is no limit.
+ */
+class TokenBucket {
+protected:
+    double rate = 0;
+    double capacity = 0;
+    double tokens = 0;
+    double lastUpdate = 0;
+
+    void refill(double now);
+public:
+    TokenBucket() {}
+    TokenBucket(double rate, double capacity, double now):rate(rate), capacity(capacity), tokens(capacity), lastUpdate(now) {}
+
+    bool isUnlimited() { return rate <= 0; }
+
+    // takes the tokens and returns true if there are enough of them
+    bool consume(double bytes, double now);
+
+    // how long to wait until 'bytes' can be consumed
+    double timeUntil(double bytes, double now);
+};
+
+} /* namespace inet */
+
+#endif /* TOKENBUCKET_H_ */
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+#
+# Decodes the binary event traces written by GossipPush (see EventTrace.h)
+# into text or CSV.
+#
+#   decode_trace.py [--csv] file.trace [file.trace ...]
+#
+
+import os
+import re
+import struct
+import sys
+
+TRACE_MAGIC = 0x43525447
+TRACE_VERSION = 1
+
+EVENT_NAMES = {1: "transition", 2: "send", 3: "receive", 4: "timer"}
+# used when GossipPacket.msg is not next to the tools directory
+PACKET_NAMES = {1: "gossip", 2: "hello", 3: "ihave", 4: "graft", 5: "prune", 6: "coded"}
+NO_MACHINE = 0xff
+
+
+def load_packet_names():
+    # the wire types are declared in the GossipWireTypes enum of GossipPacket.msg
+    msg = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "GossipPacket.msg")
+    try:
+        with open(msg) as f:
+            text = f.read()
+    except OSError:
+        return
+    enum = re.search(r"enum\s+GossipWireTypes\s*\{(.*?)\}", text, re.S)
+    if enum:
+        for name, value in re.findall(r"WIRE_(\w+)\s*=\s*(\d+)", enum.group(1)):
+            PACKET_NAMES[int(value)] = name.lower()
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def varint(self):
+        v = 0
+        shift = 0
+        while True:
+            if self.pos >= len(self.data):
+                raise ValueError("truncated trace")
+            c = self.data[self.pos]
+            self.pos += 1
+            v |= (c & 0x7f) << shift
+            if c & 0x80 == 0:
+                return v
+            shift += 7
+
+    def signed_varint(self):
+        v = self.varint()
+        return (v >> 1) ^ -(v & 1)
+
+    def string(self):
+        n = self.varint()
+        s = self.data[self.pos:self.pos + n].decode("utf-8", "replace")
+        self.pos += n
+        return s
+
+    def double(self):
+        (d,) = struct.unpack_from("<d", self.data, self.pos)
+        self.pos += 8
+        return d
+
+
+def decode(fileName):
+    with open(fileName, "rb") as f:
+        r = Reader(f.read())
+
+    if r.varint() != TRACE_MAGIC or r.varint() != TRACE_VERSION:
+        raise ValueError("%s is not a gossip trace" % fileName)
+    node = r.string()
+
+    machines = []
+    for _ in range(r.varint()):
+        name = r.string()
+        states = [r.string() for _ in range(r.varint())]
+        machines.append((name, states))
+
+    count = r.varint()
+    lost = r.varint()
+    events = []
+    for _ in range(count):
+        events.append((r.double(), r.varint(), r.varint(), r.varint(), r.signed_varint(), r.signed_varint()))
+    return node, machines, lost, events
+
+
+def describe(machines, event):
+    time, kind, machine, state, arg0, arg1 = event
+    if kind == 1:
+        if machine < len(machines):
+            name, states = machines[machine]
+            stateName = states[state] if state < len(states) else str(state)
+        else:
+            name, stateName = str(machine), str(state)
+        return "transition", name, stateName, "message %d" % arg0
+    if kind in (2, 3):
+        return EVENT_NAMES[kind], "", "", "%s %d" % (PACKET_NAMES.get(arg0, "unknown"), arg1)
+    return EVENT_NAMES.get(kind, str(kind)), "", "", "kind %d" % arg0
+
+
+def main(args):
+    load_packet_names()
+    csv = "--csv" in args
+    files = [a for a in args if a != "--csv"]
+    if not files:
+        print("usage: decode_trace.py [--csv] file.trace ...", file=sys.stderr)
+        return 1
+
+    if csv:
+        print("node,time,event,machine,state,detail")
+    for fileName in files:
+        node, machines, lost, events = decode(fileName)
+        if not csv:
+            print("# %s: %d events (%d older ones overwritten)" % (node, len(events), lost))
+        for e in events:
+            kind, machine, state, detail = describe(machines, e)
+            if csv:
+                print("%s,%.9f,%s,%s,%s,%s" % (node, e[0], kind, machine, state, detail))
+            else:
+                where = " %s -> %s" % (machine, state) if machine else ""
+                print("%.9f %-10s%s %s" % (e[0], kind, where, detail))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))